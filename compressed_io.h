@@ -0,0 +1,456 @@
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "thread_placement.h"
+
+// Streaming gzip and zstd for order files and report files. Compression and
+// decompression run on a helper thread in large blocks, handed over through a
+// short queue, so they overlap with parsing and matching. Input formats are
+// detected by their magic bytes and output formats by the file extension.
+// gzip uses zlib; zstd is loaded from libzstd.so.1 at run time, so only
+// zstd files need it.
+
+namespace compressed {
+
+enum Format { NONE, GZIP, ZSTD };
+
+constexpr size_t BLOCK_SIZE = 4 << 20;
+
+inline Format detect_format(const unsigned char* magic, size_t size) {
+    if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return GZIP;
+    if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return ZSTD;
+    return NONE;
+}
+
+inline Format format_for_path(const std::string& path) {
+    auto ends_with = [&](const char* suffix) {
+        size_t length = std::strlen(suffix);
+        return path.size() >= length && path.compare(path.size() - length, length, suffix) == 0;
+    };
+    if (ends_with(".gz")) return GZIP;
+    if (ends_with(".zst")) return ZSTD;
+    return NONE;
+}
+
+// The part of the zstd streaming API used here, which has been stable since 1.4.
+class Zstd {
+public:
+    struct InBuffer {
+        const void* src;
+        size_t size;
+        size_t pos;
+    };
+    struct OutBuffer {
+        void* dst;
+        size_t size;
+        size_t pos;
+    };
+    enum EndDirective { CONTINUE = 0, FLUSH = 1, END = 2 };
+    static constexpr int COMPRESSION_LEVEL_PARAMETER = 100;
+
+    void* (*create_dctx)();
+    size_t (*free_dctx)(void*);
+    size_t (*decompress_stream)(void*, OutBuffer*, InBuffer*);
+    void* (*create_cctx)();
+    size_t (*free_cctx)(void*);
+    size_t (*compress_stream2)(void*, OutBuffer*, InBuffer*, int);
+    size_t (*set_parameter)(void*, int, int);
+    unsigned (*is_error)(size_t);
+    const char* (*error_name)(size_t);
+
+    static const Zstd& get() {
+        static Zstd api = load();
+        return api;
+    }
+
+    void check(size_t result) const {
+        if (is_error(result)) throw std::runtime_error(std::string("zstd: ") + error_name(result));
+    }
+
+private:
+    static Zstd load() {
+        void* library = dlopen("libzstd.so.1", RTLD_NOW);
+        if (!library) throw std::runtime_error("zstd files need libzstd.so.1");
+        Zstd api;
+        bool loaded = symbol(library, "ZSTD_createDCtx", api.create_dctx) && symbol(library, "ZSTD_freeDCtx", api.free_dctx)
+                   && symbol(library, "ZSTD_decompressStream", api.decompress_stream)
+                   && symbol(library, "ZSTD_createCCtx", api.create_cctx) && symbol(library, "ZSTD_freeCCtx", api.free_cctx)
+                   && symbol(library, "ZSTD_compressStream2", api.compress_stream2)
+                   && symbol(library, "ZSTD_CCtx_setParameter", api.set_parameter)
+                   && symbol(library, "ZSTD_isError", api.is_error) && symbol(library, "ZSTD_getErrorName", api.error_name);
+        if (!loaded) throw std::runtime_error("libzstd.so.1 lacks the streaming API");
+        return api;
+    }
+
+    template <typename Function>
+    static bool symbol(void* library, const char* name, Function& function) {
+        function = reinterpret_cast<Function>(dlsym(library, name));
+        return function != nullptr;
+    }
+};
+
+// Turns a stream of input chunks into output for one format, either way.
+class Codec {
+public:
+    Codec(Format format, bool compress) : format_(format), compress_(compress) {
+        if (format_ == GZIP) {
+            std::memset(&zlib_, 0, sizeof(zlib_));
+            // 16 writes a gzip header; 32 accepts gzip or zlib headers.
+            int result = compress_ ? deflateInit2(&zlib_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)
+                                   : inflateInit2(&zlib_, 15 + 32);
+            if (result != Z_OK) throw std::runtime_error("zlib initialization failed");
+        } else {
+            const Zstd& zstd = Zstd::get();
+            context_ = compress_ ? zstd.create_cctx() : zstd.create_dctx();
+            if (!context_) throw std::bad_alloc();
+            if (compress_) zstd.check(zstd.set_parameter(context_, Zstd::COMPRESSION_LEVEL_PARAMETER, 3));
+        }
+    }
+
+    ~Codec() {
+        if (format_ == GZIP) {
+            if (compress_) deflateEnd(&zlib_);
+            else inflateEnd(&zlib_);
+        } else if (context_) {
+            if (compress_) Zstd::get().free_cctx(context_);
+            else Zstd::get().free_dctx(context_);
+        }
+    }
+
+    Codec(const Codec&) = delete;
+    Codec& operator=(const Codec&) = delete;
+
+    // Consumes all of `data` and appends the result to `out`. `last` ends
+    // the compressed stream.
+    void process(const char* data, size_t size, bool last, std::vector<char>& out) {
+        if (format_ == GZIP) process_zlib(data, size, last, out);
+        else process_zstd(data, size, last, out);
+    }
+
+    // Whether the input seen so far ends on a complete stream, so that a
+    // truncated file is an error rather than a short one.
+    bool stream_ended() const { return stream_ended_; }
+
+private:
+    void process_zlib(const char* data, size_t size, bool last, std::vector<char>& out) {
+        zlib_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zlib_.avail_in = static_cast<uInt>(size);
+        for (;;) {
+            size_t used = out.size();
+            out.resize(used + BLOCK_SIZE / 4);
+            zlib_.next_out = reinterpret_cast<Bytef*>(out.data() + used);
+            zlib_.avail_out = static_cast<uInt>(BLOCK_SIZE / 4);
+            int result = compress_ ? deflate(&zlib_, last ? Z_FINISH : Z_NO_FLUSH) : inflate(&zlib_, Z_NO_FLUSH);
+            out.resize(out.size() - zlib_.avail_out);
+            if (result != Z_OK && result != Z_BUF_ERROR && result != Z_STREAM_END) {
+                throw std::runtime_error(std::string("zlib: ") + (zlib_.msg ? zlib_.msg : "stream error"));
+            }
+            stream_ended_ = result == Z_STREAM_END;
+            if (stream_ended_) {
+                if (compress_ || zlib_.avail_in == 0) return;
+                inflateReset(&zlib_); // Concatenated gzip members, as written by `cat a.gz b.gz`
+            } else if (!(compress_ && last) && zlib_.avail_in == 0 && zlib_.avail_out != 0) {
+                return;
+            }
+        }
+    }
+
+    void process_zstd(const char* data, size_t size, bool last, std::vector<char>& out) {
+        const Zstd& zstd = Zstd::get();
+        Zstd::InBuffer in = {data, size, 0};
+        for (;;) {
+            size_t used = out.size();
+            out.resize(used + BLOCK_SIZE / 4);
+            Zstd::OutBuffer output = {out.data() + used, BLOCK_SIZE / 4, 0};
+            size_t result = compress_ ? zstd.compress_stream2(context_, &output, &in, last ? Zstd::END : Zstd::CONTINUE)
+                                      : zstd.decompress_stream(context_, &output, &in);
+            zstd.check(result);
+            out.resize(used + output.pos);
+            stream_ended_ = result == 0;
+            bool drained = in.pos == in.size && output.pos < output.size;
+            if (compress_ && last ? result == 0 : drained) return;
+        }
+    }
+
+    Format format_;
+    bool compress_;
+    z_stream zlib_;
+    void* context_ = nullptr;
+    bool stream_ended_ = false;
+};
+
+// Bounded hand-over of blocks between the caller and the helper thread. An
+// empty block marks the end of the stream.
+template <typename Block>
+class BlockQueue {
+public:
+    explicit BlockQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(Block block) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [&] { return blocks_.size() < capacity_ || abandoned_; });
+        if (abandoned_ && !block.empty()) return;
+        blocks_.push_back(std::move(block));
+        not_empty_.notify_one();
+    }
+
+    Block pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [&] { return !blocks_.empty(); });
+        Block block = std::move(blocks_.front());
+        blocks_.pop_front();
+        not_full_.notify_one();
+        return block;
+    }
+
+    bool try_pop(Block& block) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (blocks_.empty()) return false;
+        block = std::move(blocks_.front());
+        blocks_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Unblocks a producer whose consumer has stopped; from then on only the
+    // end marker is queued.
+    void abandon() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abandoned_ = true;
+        not_full_.notify_all();
+    }
+
+    bool abandoned() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return abandoned_;
+    }
+
+private:
+    size_t capacity_;
+    std::deque<Block> blocks_;
+    bool abandoned_ = false;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+// Reads a compressed file line by line. The helper thread reads and
+// decompresses ahead in blocks while the caller parses.
+class LineReader {
+public:
+    LineReader(int fd, Format format) : fd_(fd), format_(format), queue_(4) {
+        helper_ = std::thread(&LineReader::run_helper, this);
+    }
+
+    ~LineReader() {
+        queue_.abandon();
+        while (!finished_ && !queue_.pop().empty()) {
+        }
+        helper_.join();
+        close(fd_);
+    }
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    // Reads the next line without its newline, like std::getline.
+    bool next_line(std::string& line) {
+        line.clear();
+        for (;;) {
+            if (position_ < block_.size()) {
+                const char* start = block_.data() + position_;
+                const char* newline = static_cast<const char*>(std::memchr(start, '\n', block_.size() - position_));
+                size_t length = newline ? static_cast<size_t>(newline - start) : block_.size() - position_;
+                line.append(start, length);
+                position_ += length + (newline ? 1 : 0);
+                if (newline) return true;
+            }
+            if (finished_) return !line.empty();
+            next_block();
+        }
+    }
+
+private:
+    void next_block() {
+        block_ = queue_.pop();
+        position_ = 0;
+        if (block_.empty()) {
+            finished_ = true;
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_.empty()) throw std::runtime_error(error_);
+        }
+    }
+
+    void run_helper() {
+        unpin_current_thread(); // Overlaps with the matcher instead of sharing its core
+        try {
+            Codec codec(format_, false);
+            std::vector<char> input(BLOCK_SIZE);
+            std::vector<char> output;
+            for (;;) {
+                ssize_t count = read(fd_, input.data(), input.size());
+                if (count < 0 && errno == EINTR) continue;
+                if (count < 0) throw std::runtime_error(std::string("read: ") + std::strerror(errno));
+                if (count == 0 || queue_.abandoned()) break;
+                codec.process(input.data(), static_cast<size_t>(count), false, output);
+                if (output.size() >= BLOCK_SIZE) {
+                    queue_.push(std::move(output));
+                    output.clear();
+                }
+            }
+            if (!codec.stream_ended() && !queue_.abandoned()) throw std::runtime_error("compressed input is truncated");
+            if (!output.empty()) queue_.push(std::move(output));
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            error_ = e.what();
+        }
+        queue_.push(std::vector<char>());
+    }
+
+    int fd_;
+    Format format_;
+    BlockQueue<std::vector<char>> queue_;
+    std::thread helper_;
+    std::vector<char> block_;
+    size_t position_ = 0;
+    bool finished_ = false;
+    std::mutex error_mutex_;
+    std::string error_;
+};
+
+// Report output with the same reserve/commit interface as AsyncReportWriter.
+// Full blocks are compressed and written by the helper thread while the
+// caller fills the next one. Written blocks go back to the caller for reuse.
+class Writer {
+public:
+    Writer(const std::string& path, Format format) : format_(format), queue_(2), spare_(4) {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        }
+        block_.resize(BLOCK_SIZE);
+        helper_ = std::thread(&Writer::run_helper, this);
+    }
+
+    ~Writer() {
+        try {
+            finish();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Returns space for at least `size` bytes; follow with commit() of the bytes used.
+    char* reserve(size_t size) {
+        if (used_ + size > block_.size()) {
+            if (used_ > 0) submit_block();
+            if (size > block_.size()) block_.resize(size);
+        }
+        return block_.data() + used_;
+    }
+
+    void commit(size_t size) {
+        used_ += size;
+    }
+
+    void append(const char* data, size_t size) {
+        std::memcpy(reserve(size), data, size);
+        commit(size);
+    }
+
+    // Compresses what is buffered, ends the stream and waits for the helper.
+    void finish() {
+        if (fd_ < 0) return;
+        if (used_ > 0) submit_block();
+        queue_.push(Block());
+        helper_.join();
+        close(fd_);
+        fd_ = -1;
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (!error_.empty()) throw std::runtime_error("Report output failed: " + error_);
+    }
+
+private:
+    // A report block and the bytes of it in use; an empty one ends the stream.
+    struct Block {
+        std::vector<char> data;
+        size_t size = 0;
+
+        bool empty() const { return size == 0; }
+    };
+
+    // At most four blocks circulate: two queued, one being compressed and the
+    // one being filled, so the spare queue never blocks the helper.
+    void submit_block() {
+        queue_.push(Block{std::move(block_), used_});
+        if (!spare_.try_pop(block_)) block_ = std::vector<char>(BLOCK_SIZE);
+        used_ = 0;
+    }
+
+    void run_helper() {
+        unpin_current_thread(); // Overlaps with the matcher instead of sharing its core
+        try {
+            Codec codec(format_, true);
+            std::vector<char> output;
+            for (;;) {
+                Block block = queue_.pop();
+                bool last = block.empty();
+                output.clear();
+                codec.process(block.data.data(), block.size, last, output);
+                write_fully(output);
+                if (last) return;
+                spare_.push(std::move(block.data));
+            }
+        } catch (const std::exception& e) {
+            {
+                std::lock_guard<std::mutex> lock(error_mutex_);
+                error_ = e.what();
+            }
+            queue_.abandon();
+            // Consume until the end marker so finish() does not block.
+            while (!queue_.pop().empty()) {
+            }
+        }
+    }
+
+    void write_fully(const std::vector<char>& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t count = write(fd_, data.data() + written, data.size() - written);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0) throw std::runtime_error(std::string("write: ") + std::strerror(errno));
+            written += static_cast<size_t>(count);
+        }
+    }
+
+    int fd_ = -1;
+    Format format_;
+    BlockQueue<Block> queue_;
+    BlockQueue<std::vector<char>> spare_;
+    std::thread helper_;
+    std::vector<char> block_;
+    size_t used_ = 0;
+    std::mutex error_mutex_;
+    std::string error_;
+};
+
+} // namespace compressed
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "thread_placement.h"
+
+// Engine statistics. Every thread that touches the engine owns one
+// cache-line-aligned block of counters and is its only writer, so updates are
+// plain relaxed load/store pairs with no shared cache lines. Readers sum the
+// blocks of all threads when taking a snapshot.
+
+namespace stats {
+
+enum Reject { REJECT_INSTRUMENT, REJECT_SIDE, REJECT_PRICE, REJECT_QUANTITY, REJECT_ORDER_TYPE, REJECT_RISK, REJECT_THROTTLE, REJECT_REASONS };
+enum Queue { QUEUE_SHM_ORDERS, QUEUE_GATEWAY_OUTPUT, QUEUE_HELD_ORDERS, QUEUES };
+
+constexpr int MAX_THREADS = 64;
+constexpr int MAX_INSTRUMENTS = 5;
+constexpr const char* INSTRUMENTS[MAX_INSTRUMENTS] = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+constexpr const char* REJECT_NAMES[REJECT_REASONS] = {"instrument", "side", "price", "quantity", "order_type", "risk", "throttle"};
+constexpr const char* QUEUE_NAMES[QUEUES] = {"shm_order_ring", "gateway_output_bytes", "throttle_held_orders"};
+
+inline int instrument_index(const std::string& instrument) {
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        if (instrument == INSTRUMENTS[i]) return i;
+    }
+    return -1;
+}
+
+using Counter = std::atomic<uint64_t>;
+
+// Single-writer updates: no read-modify-write instruction is needed.
+inline void add(Counter& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void raise_high_water(Counter& counter, uint64_t value) {
+    if (value > counter.load(std::memory_order_relaxed)) counter.store(value, std::memory_order_relaxed);
+}
+
+struct InstrumentCounters {
+    Counter trades{0};
+    Counter volume{0};
+    std::atomic<double> notional{0.0};
+    Counter book_depth[2] = {{0}, {0}}; // Resting orders on the buy and sell side
+    Counter book_depth_high_water[2] = {{0}, {0}};
+};
+
+struct alignas(64) ThreadCounters {
+    Counter orders_in{0};
+    Counter new_orders{0};
+    Counter fills{0};
+    Counter partial_fills{0};
+    Counter cancels{0};
+    Counter stop_triggers{0};
+    Counter self_trades{0};
+    Counter rejects[REJECT_REASONS] = {};
+    Counter queue_occupancy[QUEUES] = {};
+    Counter queue_high_water[QUEUES] = {};
+    InstrumentCounters instruments[MAX_INSTRUMENTS];
+};
+
+struct Registry {
+    ThreadCounters threads[MAX_THREADS];
+    std::atomic<int> registered{0};
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+// Returns the calling thread's counters. Threads beyond MAX_THREADS share the
+// last block, whose counts may then lose updates.
+inline ThreadCounters& local() {
+    thread_local ThreadCounters* counters = nullptr;
+    if (!counters) {
+        int index = registry().registered.fetch_add(1);
+        counters = &registry().threads[std::min(index, MAX_THREADS - 1)];
+    }
+    return *counters;
+}
+
+inline void record_book_depth(int instrument, int side, uint64_t depth) {
+    if (instrument < 0) return;
+    InstrumentCounters& counters = local().instruments[instrument];
+    counters.book_depth[side - 1].store(depth, std::memory_order_relaxed);
+    raise_high_water(counters.book_depth_high_water[side - 1], depth);
+}
+
+inline void record_trade(int instrument, uint64_t quantity, double price) {
+    if (instrument < 0) return;
+    InstrumentCounters& counters = local().instruments[instrument];
+    add(counters.trades);
+    add(counters.volume, quantity);
+    counters.notional.store(counters.notional.load(std::memory_order_relaxed) + quantity * price, std::memory_order_relaxed);
+}
+
+inline void record_queue(Queue queue, uint64_t occupancy) {
+    ThreadCounters& counters = local();
+    counters.queue_occupancy[queue].store(occupancy, std::memory_order_relaxed);
+    raise_high_water(counters.queue_high_water[queue], occupancy);
+}
+
+// Renders the aggregate of all threads in the Prometheus text exposition format.
+inline std::string render_prometheus() {
+    Registry& reg = registry();
+    int threads = std::min(reg.registered.load(), MAX_THREADS);
+
+    auto sum = [&](auto member) {
+        uint64_t total = 0;
+        for (int t = 0; t < threads; ++t) total += member(reg.threads[t]).load(std::memory_order_relaxed);
+        return total;
+    };
+    auto max = [&](auto member) {
+        uint64_t highest = 0;
+        for (int t = 0; t < threads; ++t) highest = std::max<uint64_t>(highest, member(reg.threads[t]).load(std::memory_order_relaxed));
+        return highest;
+    };
+
+    std::ostringstream out;
+    auto counter = [&](const char* name, const char* type, const char* help) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    };
+
+    counter("flower_orders_total", "counter", "Orders received.");
+    out << "flower_orders_total " << sum([](ThreadCounters& c) -> Counter& { return c.orders_in; }) << "\n";
+    counter("flower_new_orders_total", "counter", "Orders acknowledged as New.");
+    out << "flower_new_orders_total " << sum([](ThreadCounters& c) -> Counter& { return c.new_orders; }) << "\n";
+    counter("flower_fills_total", "counter", "Fill execution reports.");
+    out << "flower_fills_total " << sum([](ThreadCounters& c) -> Counter& { return c.fills; }) << "\n";
+    counter("flower_partial_fills_total", "counter", "Partial fill execution reports.");
+    out << "flower_partial_fills_total " << sum([](ThreadCounters& c) -> Counter& { return c.partial_fills; }) << "\n";
+    counter("flower_cancels_total", "counter", "Cancelled reports: unfilled IOC, FOK and market orders and self-trade prevention cancels.");
+    out << "flower_cancels_total " << sum([](ThreadCounters& c) -> Counter& { return c.cancels; }) << "\n";
+    counter("flower_stop_triggers_total", "counter", "Stop and stop-limit orders released by a trade.");
+    out << "flower_stop_triggers_total " << sum([](ThreadCounters& c) -> Counter& { return c.stop_triggers; }) << "\n";
+    counter("flower_self_trades_prevented_total", "counter", "Matches stopped by self-trade prevention.");
+    out << "flower_self_trades_prevented_total " << sum([](ThreadCounters& c) -> Counter& { return c.self_trades; }) << "\n";
+
+    counter("flower_rejects_total", "counter", "Rejected orders by reason.");
+    for (int r = 0; r < REJECT_REASONS; ++r) {
+        out << "flower_rejects_total{reason=\"" << REJECT_NAMES[r] << "\"} "
+            << sum([r](ThreadCounters& c) -> Counter& { return c.rejects[r]; }) << "\n";
+    }
+
+    counter("flower_trades_total", "counter", "Trades per instrument.");
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        out << "flower_trades_total{instrument=\"" << INSTRUMENTS[i] << "\"} "
+            << sum([i](ThreadCounters& c) -> Counter& { return c.instruments[i].trades; }) << "\n";
+    }
+    counter("flower_traded_volume_total", "counter", "Traded quantity per instrument.");
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        out << "flower_traded_volume_total{instrument=\"" << INSTRUMENTS[i] << "\"} "
+            << sum([i](ThreadCounters& c) -> Counter& { return c.instruments[i].volume; }) << "\n";
+    }
+    counter("flower_traded_notional_total", "counter", "Traded quantity times price per instrument.");
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        double notional = 0;
+        for (int t = 0; t < threads; ++t) notional += reg.threads[t].instruments[i].notional.load(std::memory_order_relaxed);
+        char value[64];
+        std::snprintf(value, sizeof(value), "%.2f", notional);
+        out << "flower_traded_notional_total{instrument=\"" << INSTRUMENTS[i] << "\"} " << value << "\n";
+    }
+
+    static const char* const SIDES[2] = {"buy", "sell"};
+    counter("flower_book_depth", "gauge", "Resting orders per instrument and side.");
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        for (int s = 0; s < 2; ++s) {
+            out << "flower_book_depth{instrument=\"" << INSTRUMENTS[i] << "\",side=\"" << SIDES[s] << "\"} "
+                << sum([i, s](ThreadCounters& c) -> Counter& { return c.instruments[i].book_depth[s]; }) << "\n";
+        }
+    }
+    counter("flower_book_depth_high_water", "gauge", "Highest resting order count per instrument and side.");
+    for (int i = 0; i < MAX_INSTRUMENTS; ++i) {
+        for (int s = 0; s < 2; ++s) {
+            out << "flower_book_depth_high_water{instrument=\"" << INSTRUMENTS[i] << "\",side=\"" << SIDES[s] << "\"} "
+                << max([i, s](ThreadCounters& c) -> Counter& { return c.instruments[i].book_depth_high_water[s]; }) << "\n";
+        }
+    }
+
+    counter("flower_queue_occupancy", "gauge", "Current queue occupancy.");
+    for (int q = 0; q < QUEUES; ++q) {
+        out << "flower_queue_occupancy{queue=\"" << QUEUE_NAMES[q] << "\"} "
+            << sum([q](ThreadCounters& c) -> Counter& { return c.queue_occupancy[q]; }) << "\n";
+    }
+    counter("flower_queue_occupancy_high_water", "gauge", "Highest observed queue occupancy.");
+    for (int q = 0; q < QUEUES; ++q) {
+        out << "flower_queue_occupancy_high_water{queue=\"" << QUEUE_NAMES[q] << "\"} "
+            << max([q](ThreadCounters& c) -> Counter& { return c.queue_high_water[q]; }) << "\n";
+    }
+    return out.str();
+}
+
+// Writes a snapshot atomically, so readers never see a partial file.
+inline bool write_stats_file(const std::string& path) {
+    std::string temp_path = path + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "w");
+    if (!file) return false;
+    std::string text = render_prometheus();
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = std::fclose(file) == 0 && ok;
+    return ok && std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+// Background publisher: rewrites a stats file every interval and/or answers
+// any TCP connection on a localhost port with a Prometheus text dump.
+class Publisher {
+public:
+    Publisher(const std::string& file_path, int interval_ms, int port, int cpu = -1)
+        : file_path_(file_path), interval_ms_(std::max(interval_ms, 10)), cpu_(cpu) {
+        if (port > 0) listen_fd_ = open_listener(port);
+        if (!file_path_.empty() || listen_fd_ >= 0) {
+            thread_ = std::thread(&Publisher::run, this);
+        }
+    }
+
+    ~Publisher() {
+        stop_.store(true);
+        if (thread_.joinable()) thread_.join();
+        if (listen_fd_ >= 0) close(listen_fd_);
+        if (!file_path_.empty()) write_stats_file(file_path_);
+    }
+
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+
+private:
+    static int open_listener(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+            std::fprintf(stderr, "Could not open stats port %d: %s\n", port, std::strerror(errno));
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void serve_one() {
+        int client = accept(listen_fd_, nullptr, nullptr);
+        if (client < 0) return;
+        // The request itself is ignored; every connection gets the full dump.
+        char request[1024];
+        pollfd pfd{client, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0) {
+            ssize_t ignored = recv(client, request, sizeof(request), 0);
+            (void)ignored;
+        }
+        std::string body = render_prometheus();
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                               + std::to_string(body.size()) + "\r\n\r\n" + body;
+        size_t offset = 0;
+        while (offset < response.size()) {
+            ssize_t written = send(client, response.data() + offset, response.size() - offset, MSG_NOSIGNAL);
+            if (written <= 0) break;
+            offset += written;
+        }
+        close(client);
+    }
+
+    void run() {
+        pin_current_thread(cpu_);
+        auto next_write = std::chrono::steady_clock::now();
+        while (!stop_.load()) {
+            auto now = std::chrono::steady_clock::now();
+            if (!file_path_.empty() && now >= next_write) {
+                write_stats_file(file_path_);
+                next_write = now + std::chrono::milliseconds(interval_ms_);
+            }
+            int timeout_ms = 100;
+            if (listen_fd_ >= 0) {
+                pollfd pfd{listen_fd_, POLLIN, 0};
+                if (poll(&pfd, 1, timeout_ms) > 0) serve_one();
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, interval_ms_)));
+            }
+        }
+    }
+
+    std::string file_path_;
+    int interval_ms_;
+    int cpu_;
+    int listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
+
+} // namespace stats
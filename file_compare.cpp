@@ -1,70 +1,343 @@
 #include <algorithm>
-#include <chrono>
-#include <fstream>
-#include <functional>
-#include <iomanip>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <map>
-#include <queue>
-#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
-std::vector<std::vector<std::string>> readSelectedColumns(const std::string& filename, const std::set<int>& columns) {
-    std::vector<std::vector<std::string>> data;
-    std::ifstream file(filename);
-    std::string line;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string cell;
-        std::vector<std::string> rowData;
-        int colIndex = 0;
+// Compares two execution report files column by column. Both files are
+// mapped read-only and split into line-aligned chunks that are compared by
+// separate threads, so memory use does not grow with the file size. Rows that
+// are byte-identical are skipped with one memcmp; the others are compared on
+// the selected columns only, with price columns compared as numbers.
 
-        while (std::getline(ss, cell, ',')) {
-            if (columns.find(colIndex) != columns.end()) {
-                rowData.push_back(cell);
+struct CompareOptions {
+    std::string expected_path = "test/inputs/execution-rep-correct";
+    std::string actual_path = "test/outputs/execution_rep";
+    std::string columns;              // Names or indexes, empty for all
+    std::string ignored;              // Names or indexes left out of the comparison
+    bool normalize_prices = true;     // Compare columns named *Price* as numbers
+    size_t max_differences = 10;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) close(fd);
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        }
+        size_ = static_cast<size_t>(info.st_size);
+        if (size_ > 0) {
+            void* memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Could not map " + path + ": " + std::strerror(errno));
             }
-            colIndex++;
+            data_ = static_cast<const char*>(memory);
+            madvise(memory, size_, MADV_SEQUENTIAL);
         }
+        close(fd);
+    }
 
-        data.push_back(rowData);
+    ~MappedFile() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
     }
 
-    return data;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// A line without its newline (or trailing carriage return).
+struct Line {
+    const char* data;
+    size_t size;
+};
+
+// Returns the line starting at `offset` and moves `offset` past it.
+Line nextLine(const MappedFile& file, size_t& offset) {
+    const char* start = file.data() + offset;
+    const char* newline = static_cast<const char*>(std::memchr(start, '\n', file.size() - offset));
+    size_t size = newline ? static_cast<size_t>(newline - start) : file.size() - offset;
+    offset += size + (newline ? 1 : 0);
+    if (size > 0 && start[size - 1] == '\r') --size;
+    return {start, size};
 }
 
-bool compareData(const std::vector<std::vector<std::string>>& data1, const std::vector<std::vector<std::string>>& data2) {
-    if (data1.size() != data2.size()) {
-        return false;
+// Splits a line into its comma-separated fields.
+std::vector<std::string> splitLine(const Line& line) {
+    std::vector<std::string> fields;
+    std::stringstream ss(std::string(line.data, line.size));
+    std::string cell;
+    while (std::getline(ss, cell, ',')) {
+        fields.push_back(cell);
     }
+    return fields;
+}
+
+struct ColumnSpec {
+    std::vector<bool> selected; // Per column; columns past the end are selected if `all` is set
+    std::vector<bool> price;
+    bool all = true;
+
+    bool isSelected(size_t column) const { return column < selected.size() ? selected[column] : all; }
+    bool isPrice(size_t column) const { return column < price.size() && price[column]; }
+};
 
-    for (size_t i = 0; i < data1.size(); ++i) {
-        if (data1[i] != data2[i]) {
+bool resolveColumns(const std::string& list, const std::vector<std::string>& header, std::vector<size_t>& columns) {
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        auto it = std::find(header.begin(), header.end(), name);
+        if (it != header.end()) {
+            columns.push_back(static_cast<size_t>(it - header.begin()));
+            continue;
+        }
+        if (name.empty() || !std::all_of(name.begin(), name.end(), ::isdigit)) {
+            std::cerr << "Unknown column: " << name << std::endl;
             return false;
         }
+        columns.push_back(std::stoul(name));
+    }
+    return true;
+}
+
+bool buildColumnSpec(const CompareOptions& options, const std::vector<std::string>& header, ColumnSpec& spec) {
+    size_t width = header.size();
+    std::vector<size_t> chosen, ignored;
+    if (!resolveColumns(options.columns, header, chosen) || !resolveColumns(options.ignored, header, ignored)) return false;
+    for (size_t column : chosen) width = std::max(width, column + 1);
+    for (size_t column : ignored) width = std::max(width, column + 1);
+
+    spec.all = chosen.empty();
+    spec.selected.assign(width, spec.all);
+    for (size_t column : chosen) spec.selected[column] = true;
+    for (size_t column : ignored) spec.selected[column] = false;
+
+    spec.price.assign(width, false);
+    if (options.normalize_prices) {
+        for (size_t column = 0; column < header.size(); ++column) {
+            spec.price[column] = header[column].find("Price") != std::string::npos;
+        }
     }
+    return true;
+}
 
+bool fieldsMatch(const char* a, size_t a_size, const char* b, size_t b_size, bool price) {
+    if (a_size == b_size && std::memcmp(a, b, a_size) == 0) return true;
+    if (!price) return false;
+    double x, y;
+    auto parsed_a = std::from_chars(a, a + a_size, x);
+    auto parsed_b = std::from_chars(b, b + b_size, y);
+    return parsed_a.ec == std::errc() && parsed_a.ptr == a + a_size
+        && parsed_b.ec == std::errc() && parsed_b.ptr == b + b_size && x == y;
+}
+
+// Walks both lines field by field; a line with fewer fields compares as if
+// it ended in empty ones.
+bool linesMatch(const Line& a, const Line& b, const ColumnSpec& spec) {
+    if (a.size == b.size && std::memcmp(a.data, b.data, a.size) == 0) return true;
+
+    size_t a_pos = 0, b_pos = 0;
+    bool a_done = false, b_done = false;
+    for (size_t column = 0; !(a_done && b_done); ++column) {
+        if (!spec.all && column >= spec.selected.size()) return true;
+
+        auto field = [](const Line& line, size_t& pos, bool& done, size_t& size) {
+            const char* start = line.data + pos;
+            if (done) {
+                size = 0;
+                return start;
+            }
+            const char* comma = static_cast<const char*>(std::memchr(start, ',', line.size - pos));
+            size = comma ? static_cast<size_t>(comma - start) : line.size - pos;
+            pos += size + 1;
+            if (!comma) done = true;
+            return start;
+        };
+        size_t a_size, b_size;
+        const char* a_field = field(a, a_pos, a_done, a_size);
+        const char* b_field = field(b, b_pos, b_done, b_size);
+        if (spec.isSelected(column) && !fieldsMatch(a_field, a_size, b_field, b_size, spec.isPrice(column))) return false;
+    }
     return true;
 }
 
-int main() {
-    std::set<int> columnsToCompare = {0, 1, 2, 3, 4, 5, 6}; 
+struct Difference {
+    size_t line_number;
+    std::string expected;
+    std::string actual;
+};
 
-    std::string correct_file_path = "test/inputs/execution-rep-correct";
-    std::string output_file_path = "test/outputs/execution_rep";
+struct ChunkResult {
+    size_t differences = 0;
+    std::vector<Difference> first; // At most max_differences, in line order
+};
 
-    std::vector<std::vector<std::string>> csvData1 = readSelectedColumns(correct_file_path, columnsToCompare);
-    std::vector<std::vector<std::string>> csvData2 = readSelectedColumns(output_file_path, columnsToCompare);
+// Byte offsets of the starts of `parts` line-aligned chunks of a file, plus its end.
+std::vector<size_t> chunkStarts(const MappedFile& file, size_t parts) {
+    std::vector<size_t> starts = {0};
+    for (size_t i = 1; i < parts; ++i) {
+        size_t offset = std::max(starts.back(), file.size() * i / parts);
+        const char* newline = offset < file.size()
+                                  ? static_cast<const char*>(std::memchr(file.data() + offset, '\n', file.size() - offset))
+                                  : nullptr;
+        starts.push_back(newline ? static_cast<size_t>(newline - file.data()) + 1 : file.size());
+    }
+    starts.push_back(file.size());
+    return starts;
+}
+
+size_t countLines(const MappedFile& file, size_t begin, size_t end) {
+    size_t lines = 0;
+    const char* p = file.data() + begin;
+    const char* last = file.data() + end;
+    while (p < last && (p = static_cast<const char*>(std::memchr(p, '\n', last - p)))) {
+        ++lines;
+        ++p;
+    }
+    return lines;
+}
+
+template <typename Task>
+void runParallel(size_t count, Task task) {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; ++i) threads.emplace_back(task, i);
+    for (std::thread& thread : threads) thread.join();
+}
+
+int compareFiles(const CompareOptions& options) {
+    MappedFile expected(options.expected_path);
+    MappedFile actual(options.actual_path);
+
+    ColumnSpec spec;
+    size_t header_offset = 0;
+    std::vector<std::string> header = expected.size() > 0 ? splitLine(nextLine(expected, header_offset)) : std::vector<std::string>();
+    if (!buildColumnSpec(options, header, spec)) return 2;
+
+    // Split the expected file into chunks, then find where the same lines start in the actual file.
+    size_t parts = options.threads;
+    std::vector<size_t> expected_starts = chunkStarts(expected, parts);
+    std::vector<size_t> actual_chunks = chunkStarts(actual, parts);
+    std::vector<size_t> expected_lines(parts), actual_lines(parts);
+    runParallel(parts, [&](size_t i) {
+        expected_lines[i] = countLines(expected, expected_starts[i], expected_starts[i + 1]);
+        actual_lines[i] = countLines(actual, actual_chunks[i], actual_chunks[i + 1]);
+    });
+
+    std::vector<size_t> first_line(parts + 1, 0);
+    for (size_t i = 0; i < parts; ++i) first_line[i + 1] = first_line[i] + expected_lines[i];
+
+    std::vector<size_t> actual_starts(parts + 1, actual.size());
+    runParallel(parts, [&](size_t i) {
+        size_t line = first_line[i], chunk = 0, chunk_line = 0;
+        while (chunk < parts && chunk_line + actual_lines[chunk] <= line) chunk_line += actual_lines[chunk++];
+        if (chunk == parts) return; // The actual file is shorter
+        size_t offset = actual_chunks[chunk];
+        for (; chunk_line < line; ++chunk_line) nextLine(actual, offset);
+        actual_starts[i] = offset;
+    });
+
+    std::vector<ChunkResult> results(parts);
+    runParallel(parts, [&](size_t i) {
+        ChunkResult& result = results[i];
+        size_t expected_offset = expected_starts[i], actual_offset = actual_starts[i];
+        size_t expected_end = expected_starts[i + 1];
+        // The last chunk also takes what is left of the actual file.
+        size_t actual_end = i + 1 < parts ? actual_starts[i + 1] : actual.size();
+        for (size_t line = first_line[i] + 1; expected_offset < expected_end || actual_offset < actual_end; ++line) {
+            bool has_expected = expected_offset < expected_end, has_actual = actual_offset < actual_end;
+            Line a = has_expected ? nextLine(expected, expected_offset) : Line{"", 0};
+            Line b = has_actual ? nextLine(actual, actual_offset) : Line{"", 0};
+            if (has_expected && has_actual && linesMatch(a, b, spec)) continue;
 
-    bool areSimilar = compareData(csvData1, csvData2);
+            ++result.differences;
+            if (result.first.size() < options.max_differences) {
+                result.first.push_back({line, has_expected ? std::string(a.data, a.size) : "<missing>",
+                                        has_actual ? std::string(b.data, b.size) : "<missing>"});
+            }
+        }
+    });
 
-    if (areSimilar) {
+    size_t differences = 0, shown = 0;
+    for (const ChunkResult& result : results) {
+        differences += result.differences;
+        for (const Difference& difference : result.first) {
+            if (shown++ >= options.max_differences) break;
+            std::cout << "Line " << difference.line_number << ":\n"
+                      << "  expected: " << difference.expected << "\n"
+                      << "  actual:   " << difference.actual << "\n";
+        }
+    }
+
+    if (differences == 0) {
         std::cout << "The selected columns in the CSV files are similar." << std::endl;
-    } else {
-        std::cout << "The selected columns in the CSV files differ." << std::endl;
+        return 0;
     }
+    std::cout << "The selected columns in the CSV files differ: " << differences << " rows." << std::endl;
+    return 1;
+}
 
-    return 0;
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] [expected.csv actual.csv]\n"
+              << "Options:\n"
+              << "  --columns list     Columns to compare, by name or index (default all)\n"
+              << "  --ignore list      Columns to leave out, e.g. \"Transaction Time\"\n"
+              << "  --exact-prices     Compare price columns as text instead of as numbers\n"
+              << "  --max-diffs n      Differing rows to print (default 10)\n"
+              << "  --threads n        Comparison threads (default: one per core)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    CompareOptions options;
+    std::vector<std::string> positional;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--columns" && has_value) options.columns = argv[++i];
+            else if (arg == "--ignore" && has_value) options.ignored = argv[++i];
+            else if (arg == "--exact-prices") options.normalize_prices = false;
+            else if (arg == "--max-diffs" && has_value) options.max_differences = std::stoul(argv[++i]);
+            else if (arg == "--threads" && has_value) options.threads = std::max(1, std::stoi(argv[++i]));
+            else if (arg.rfind("--", 0) == 0) throw std::invalid_argument(arg);
+            else positional.push_back(arg);
+        }
+    } catch (const std::exception&) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (positional.size() == 2) {
+        options.expected_path = positional[0];
+        options.actual_path = positional[1];
+    } else if (!positional.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    try {
+        return compareFiles(options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
 }
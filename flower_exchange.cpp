@@ -0,0 +1,148 @@
+#include "flower_exchange.h"
+
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "matching_engine.h"
+
+// The C records only point at the strings of the engine's own reports, so
+// building them copies no text.
+
+struct flower_engine {
+    EngineConfig config; // Kept so that setters can reconfigure the engine
+    MatchingEngine engine;
+    std::vector<flower_report> reports;
+    OrderStatus status; // Backs the strings of the last flower_order_status
+    flower_report_callback callback = nullptr;
+    void* user_data = nullptr;
+
+    explicit flower_engine(const EngineConfig& engine_config) : config(engine_config), engine(engine_config) {}
+};
+
+namespace {
+
+EngineConfig make_config(const flower_engine_config* config) {
+    EngineConfig result;
+    if (config == nullptr) return result;
+    if (config->self_trade_policy == 1) result.self_trade_policy = STP_CANCEL_OLDEST;
+    else if (config->self_trade_policy == 2) result.self_trade_policy = STP_CANCEL_BOTH;
+    result.risk_limits.max_notional = config->max_notional;
+    result.risk_limits.max_open_quantity = config->max_open_quantity;
+    result.risk_limits.max_position = config->max_position;
+    return result;
+}
+
+Order make_order(const flower_order& order) {
+    auto text = [](const char* value) { return value != nullptr ? value : ""; };
+    Order result(text(order.order_id), text(order.client_order_id), text(order.instrument), order.side, order.price, order.quantity);
+    result.order_type = order.order_type;
+    result.time_in_force = order.time_in_force;
+    result.stop_price = order.stop_price;
+    result.display_quantity = order.display_quantity;
+    result.trader_id = order.trader_id;
+    return result;
+}
+
+flower_report make_report(const ExecutionReport& report) {
+    return {report.order_id.c_str(), report.client_order_id.c_str(), report.instrument.c_str(), report.side,
+            report.exec_status, report.quantity, report.price, report.reason.c_str(), report.timestamp.c_str(),
+            report.trader_id};
+}
+
+long finish_call(flower_engine* engine, const ReportSpan& span, const flower_report** reports) {
+    engine->reports.clear();
+    for (const ExecutionReport& report : span) {
+        engine->reports.push_back(make_report(report));
+    }
+    if (engine->callback) {
+        for (const flower_report& report : engine->reports) engine->callback(&report, engine->user_data);
+    }
+    if (reports != nullptr) *reports = engine->reports.data();
+    return static_cast<long>(engine->reports.size());
+}
+
+} // namespace
+
+extern "C" {
+
+int flower_api_version(void) {
+    return FLOWER_EXCHANGE_API_VERSION;
+}
+
+flower_engine* flower_engine_create(const flower_engine_config* config) {
+    try {
+        return new flower_engine(make_config(config));
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_create: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void flower_engine_destroy(flower_engine* engine) {
+    delete engine;
+}
+
+void flower_engine_set_callback(flower_engine* engine, flower_report_callback callback, void* user_data) {
+    engine->callback = callback;
+    engine->user_data = user_data;
+}
+
+long flower_engine_submit(flower_engine* engine, const flower_order* order, const flower_report** reports) {
+    try {
+        Order request = make_order(*order);
+        return finish_call(engine, engine->engine.submit(request), reports);
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_submit: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+long flower_engine_collect(flower_engine* engine, const flower_order* order, const flower_report** reports) {
+    try {
+        Order request = make_order(*order);
+        return finish_call(engine, engine->engine.collect(request), reports);
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_collect: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+long flower_engine_uncross(flower_engine* engine, const flower_report** reports) {
+    try {
+        return finish_call(engine, engine->engine.uncross(), reports);
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_uncross: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int flower_engine_enable_order_status(flower_engine* engine, int enabled) {
+    try {
+        engine->config.track_order_status = enabled != 0;
+        engine->engine.reconfigure(engine->config);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_enable_order_status: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int flower_engine_order_status(flower_engine* engine, const char* client_order_id, flower_order_status* status) {
+    try {
+        OrderStatus& found = engine->status;
+        if (!engine->engine.order_status(client_order_id, found)) return 0;
+        *status = {found.order_id.c_str(), found.instrument.c_str(), found.side, found.exec_status, found.quantity,
+                   found.open_quantity, found.filled_quantity, found.average_price};
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << "flower_engine_order_status: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+void flower_set_fixed_clock(int fixed) {
+    set_fixed_clock(fixed != 0);
+}
+
+} // extern "C"
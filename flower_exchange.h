@@ -0,0 +1,100 @@
+#ifndef FLOWER_EXCHANGE_H
+#define FLOWER_EXCHANGE_H
+
+#include <stddef.h>
+
+/* C interface to the matching engine (matching_engine.h). Reports point into
+ * memory owned by the engine and stay valid until the engine's next call.
+ * Codes are those of the CSV files: side 1 buy and 2 sell; order types and
+ * time in force as in order_types.h; exec status 0 New, 1 Rejected, 2 Fill,
+ * 3 PFill and 4 Cancelled. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLOWER_EXCHANGE_API_VERSION 2
+
+typedef struct flower_engine flower_engine;
+
+typedef struct {
+    int self_trade_policy; /* 0 cancel newest, 1 cancel oldest, 2 cancel both */
+    double max_notional;   /* Risk limits per trader, 0 disables */
+    int max_open_quantity;
+    int max_position;
+} flower_engine_config;
+
+typedef struct {
+    const char* order_id; /* NULL or "" to have the engine number the order */
+    const char* client_order_id;
+    const char* instrument;
+    int side;
+    int quantity;
+    double price;
+    int order_type;
+    int time_in_force;
+    double stop_price;
+    int display_quantity;
+    int trader_id; /* 0 for none */
+} flower_order;
+
+typedef struct {
+    const char* order_id;
+    const char* client_order_id;
+    const char* instrument;
+    int side;
+    int exec_status;
+    int quantity;
+    double price;
+    const char* reason;
+    const char* timestamp;
+    int trader_id;
+} flower_report;
+
+typedef struct {
+    const char* order_id;
+    const char* instrument;
+    int side;
+    int exec_status; /* Of the order's last report, -1 before its first */
+    int quantity;
+    int open_quantity;
+    int filled_quantity;
+    double average_price;
+} flower_order_status;
+
+typedef void (*flower_report_callback)(const flower_report* report, void* user_data);
+
+int flower_api_version(void);
+
+/* A NULL config uses the defaults. Returns NULL on failure. */
+flower_engine* flower_engine_create(const flower_engine_config* config);
+void flower_engine_destroy(flower_engine* engine);
+
+/* Called with every report, before the call that produced it returns. */
+void flower_engine_set_callback(flower_engine* engine, flower_report_callback callback, void* user_data);
+
+/* Each call returns its number of reports and, if `reports` is not NULL,
+ * points it at them. Returns -1 on failure. */
+long flower_engine_submit(flower_engine* engine, const flower_order* order, const flower_report** reports);
+long flower_engine_collect(flower_engine* engine, const flower_order* order, const flower_report** reports);
+long flower_engine_uncross(flower_engine* engine, const flower_report** reports);
+
+/* Non-zero keeps the index behind flower_engine_order_status; it is off by
+ * default. Orders submitted before it is enabled are not indexed. Returns 0,
+ * or -1 on failure. Since version 2; the config struct keeps its version 1
+ * layout. */
+int flower_engine_enable_order_status(flower_engine* engine, int enabled);
+
+/* Status of the latest order with this client order ID. Returns 1 and fills
+ * `status`, whose strings stay valid until the engine's next call, 0 for an
+ * unknown ID or -1 on failure. Needs flower_engine_enable_order_status. */
+int flower_engine_order_status(flower_engine* engine, const char* client_order_id, flower_order_status* status);
+
+/* Constant transaction times for the whole process, for reproducible output. */
+void flower_set_fixed_clock(int fixed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,842 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "matching_engine.h"
+
+// Differential fuzzer: generates random order streams, matches them with a
+// deliberately simple reference matcher and checks that the engine library,
+// each file mode of the exchange binary and any candidate programs report the
+// same orders, fills and prices in the same sequence. A final run over one
+// large stream times every engine, as a throughput scoreboard.
+
+namespace fs = std::filesystem;
+
+struct FuzzOptions {
+    std::string engine = "./submission";
+    uint64_t seed = 1;
+    int iterations = 100;
+    int orders = 2000;        // Orders per fuzzed stream
+    int bench_orders = 200000; // Orders in the throughput stream, 0 skips it
+    bool basic = false;        // Plain limit, market, IOC and FOK orders only
+    std::vector<std::pair<std::string, std::string>> candidates; // name, program
+};
+
+struct EngineMode {
+    std::string name;
+    std::vector<std::string> args;
+};
+
+// Session settings of one stream, passed to every engine.
+struct StreamConfig {
+    std::string stp = "newest";
+    double max_notional = 0;
+    int max_open_quantity = 0;
+    int max_position = 0;
+    size_t open_auction = 0; // Orders in the opening and closing calls
+    size_t close_auction = 0;
+
+    std::vector<std::string> args() const {
+        std::vector<std::string> args = {"--stp", stp};
+        auto add = [&](const char* name, double value) {
+            std::ostringstream text;
+            text << value;
+            if (value > 0) args.insert(args.end(), {name, text.str()});
+        };
+        add("--max-notional", max_notional);
+        add("--max-open-quantity", max_open_quantity);
+        add("--max-position", max_position);
+        add("--open-auction", static_cast<double>(open_auction));
+        add("--close-auction", static_cast<double>(close_auction));
+        return args;
+    }
+
+    EngineConfig engine_config() const {
+        EngineConfig config;
+        config.self_trade_policy = stp == "oldest" ? STP_CANCEL_OLDEST : stp == "both" ? STP_CANCEL_BOTH : STP_CANCEL_NEWEST;
+        config.risk_limits.max_notional = max_notional;
+        config.risk_limits.max_open_quantity = max_open_quantity;
+        config.risk_limits.max_position = max_position;
+        return config;
+    }
+
+    AuctionSchedule auction() const {
+        AuctionSchedule schedule;
+        schedule.open_orders = open_auction;
+        schedule.close_orders = close_auction;
+        return schedule;
+    }
+};
+
+struct FuzzOrder {
+    std::string client_order_id;
+    std::string instrument;
+    int side;
+    int quantity;
+    std::string price; // As written to the file; empty for market and stop orders
+    std::string order_type;
+    std::string time_in_force;
+    std::string stop_price;
+    int display_quantity = 0; // 0 leaves the cell empty
+    std::string trader;
+};
+
+struct FuzzStream {
+    StreamConfig config;
+    std::vector<FuzzOrder> orders;
+};
+
+// Mostly valid orders around a mid price, so that books build up and cross,
+// with some invalid fields. Unless `basic`, streams also get traders under a
+// random self-trade policy, stops, icebergs, call auctions and risk limits.
+FuzzStream generate_stream(uint64_t seed, int count, bool basic) {
+    static const std::vector<std::string> instruments = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+    std::mt19937_64 random(seed);
+    auto chance = [&](double p) { return std::uniform_real_distribution<double>(0, 1)(random) < p; };
+    auto between = [&](int low, int high) { return std::uniform_int_distribution<int>(low, high)(random); };
+
+    int instrument_count = between(1, 5);
+    int mid_ticks = between(200, 600); // In quarter ticks
+    int spread_ticks = between(4, 40);
+    int max_lots = chance(0.5) ? 10 : 100;
+    int trader_count = between(1, 6);
+    auto price_text = [&]() {
+        int ticks = mid_ticks + between(-spread_ticks, spread_ticks);
+        std::ostringstream price;
+        price << ticks / 4 << "." << std::setw(2) << std::setfill('0') << (ticks % 4) * 25;
+        return price.str();
+    };
+
+    FuzzStream stream;
+    StreamConfig& config = stream.config;
+    if (!basic) {
+        config.stp = std::vector<std::string>{"newest", "oldest", "both"}[between(0, 2)];
+        if (chance(0.3)) {
+            if (chance(0.5)) config.max_notional = 1000.0 * between(5, 60);
+            if (chance(0.5)) config.max_open_quantity = 10 * between(20, 200);
+            if (chance(0.5)) config.max_position = 10 * between(20, 200);
+        }
+        if (chance(0.3)) {
+            config.open_auction = chance(0.7) ? between(0, count / 4) : 0;
+            config.close_auction = chance(0.7) ? between(0, count / 4) : 0;
+        }
+    }
+
+    stream.orders.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        FuzzOrder order;
+        order.client_order_id = "f" + std::to_string(i);
+        order.instrument = chance(0.02) ? "Daisy" : instruments[between(0, instrument_count - 1)];
+        order.side = chance(0.01) ? 3 : between(1, 2);
+        order.quantity = chance(0.03) ? (chance(0.5) ? 15 : 1010) : 10 * between(1, max_lots);
+        double kind = std::uniform_real_distribution<double>(0, 1)(random);
+        if (kind < 0.05) {
+            order.order_type = "Market";
+        } else if (!basic && kind < 0.09) {
+            order.order_type = "Stop";
+        } else {
+            if (!basic && kind < 0.13) order.order_type = "Stop Limit";
+            else if (chance(0.5)) order.order_type = "Limit";
+            order.price = chance(0.02) ? (chance(0.5) ? "0" : "-1") : price_text();
+        }
+        if (order.order_type == "Stop" || order.order_type == "Stop Limit") {
+            order.stop_price = chance(0.02) ? "0" : price_text();
+        }
+        if (chance(0.05)) order.time_in_force = "IOC";
+        else if (chance(0.03)) order.time_in_force = "FOK";
+        if (!basic) {
+            if (chance(0.1)) order.display_quantity = chance(0.1) ? 15 : 10 * between(1, std::max(1, order.quantity / 20));
+            if (!chance(0.25)) order.trader = "T" + std::to_string(between(1, trader_count));
+        }
+        stream.orders.push_back(order);
+    }
+    return stream;
+}
+
+bool write_orders(const std::string& path, const std::vector<FuzzOrder>& orders, bool basic) {
+    std::ofstream file(path);
+    if (!file.is_open()) return false;
+    file << "Client Order ID,Instrument,Side,Quantity,Price,Order Type,Time In Force";
+    file << (basic ? "\n" : ",Stop Price,Display Quantity,Trader\n");
+    for (const FuzzOrder& order : orders) {
+        file << order.client_order_id << "," << order.instrument << "," << order.side << "," << order.quantity << ","
+             << order.price << "," << order.order_type << "," << order.time_in_force;
+        if (!basic) {
+            file << "," << order.stop_price << ",";
+            if (order.display_quantity > 0) file << order.display_quantity;
+            file << "," << order.trader;
+        }
+        file << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+enum { NEW = 0, REJECTED = 1, FILL = 2, PFILL = 3, CANCELLED = 4 };
+
+struct Report {
+    std::string client_order_id;
+    std::string order_id;
+    std::string instrument;
+    int side;
+    double price;
+    int quantity;
+    int status;
+    int trader;
+};
+
+// A report as compared: client order ID, order ID, instrument, side, price,
+// quantity and status. Reasons and transaction times are left out.
+std::string report_row(const Report& report) {
+    std::ostringstream row;
+    row << report.client_order_id << "," << report.order_id << "," << report.instrument << ","
+        << (report.side == 1 ? "Buy" : "Sell") << "," << report.price << "," << report.quantity << "," << report.status;
+    return row.str();
+}
+
+// An order as the reference sees it once its fields are parsed.
+struct RefOrder {
+    std::string order_id;
+    std::string client_order_id;
+    std::string instrument;
+    int side;
+    int quantity;
+    double price;
+    std::string order_type; // Limit, Market, Stop or Stop Limit
+    std::string time_in_force;
+    double stop_price;
+    int display_quantity;
+    int trader; // 0 for none
+};
+
+struct RestingOrder {
+    std::string order_id;
+    std::string client_order_id;
+    int trader;
+    int displayed;
+    int hidden; // Iceberg reserve
+    int display_quantity;
+};
+
+// The reference: per book side, a std::map of price levels, each a std::list
+// in time priority, walked one order at a time. Written for obviousness, not
+// speed.
+class ReferenceMatcher {
+public:
+    std::vector<std::string> run(const FuzzStream& stream) {
+        config_ = stream.config;
+        reports_.clear();
+        books_.clear();
+        stops_.clear();
+        triggered_.clear();
+        exposure_.clear();
+        traders_.clear();
+
+        const std::vector<FuzzOrder>& orders = stream.orders;
+        size_t open_end = std::min(config_.open_auction, orders.size());
+        size_t close_start = std::max(open_end, orders.size() - std::min(config_.close_auction, orders.size()));
+        for (size_t i = 0; i < orders.size(); ++i) {
+            RefOrder order = parse(orders[i], "ord" + std::to_string(i + 1));
+            if (i >= open_end && i < close_start) {
+                submit(order);
+                continue;
+            }
+            collect(order);
+            if (i + 1 == open_end || i + 1 == orders.size()) uncross();
+        }
+
+        std::vector<std::string> rows;
+        rows.reserve(reports_.size());
+        for (const Report& report : reports_) rows.push_back(report_row(report));
+        return rows;
+    }
+
+private:
+    using Level = std::list<RestingOrder>;
+
+    struct Book {
+        std::map<double, Level, std::greater<double>> bids;
+        std::map<double, Level> asks;
+    };
+
+    struct Stops {
+        std::multimap<double, RefOrder> buys;                       // Released when the last trade rises to the key
+        std::multimap<double, RefOrder, std::greater<double>> sells; // Released when it falls to the key
+        double last_price = 0;
+        bool traded = false;
+    };
+
+    struct Exposure {
+        int open_buy = 0;
+        int open_sell = 0;
+        int position = 0;
+    };
+
+    RefOrder parse(const FuzzOrder& order, const std::string& order_id) {
+        std::string type = order.order_type.empty() ? "Limit" : order.order_type;
+        bool unpriced = type == "Market" || type == "Stop";
+        int trader = 0;
+        if (!order.trader.empty()) trader = traders_.emplace(order.trader, static_cast<int>(traders_.size()) + 1).first->second;
+        return {order_id, order.client_order_id, order.instrument, order.side, order.quantity,
+                unpriced && order.price.empty() ? 0.0 : std::stod(order.price), type, order.time_in_force,
+                order.stop_price.empty() ? 0.0 : std::stod(order.stop_price), order.display_quantity, trader};
+    }
+
+    void report(const RefOrder& order, double price, int quantity, int status) {
+        reports_.push_back({order.client_order_id, order.order_id, order.instrument, order.side, price, quantity, status, order.trader});
+    }
+
+    void report(const RestingOrder& order, const std::string& instrument, int side, double price, int quantity, int status) {
+        reports_.push_back({order.client_order_id, order.order_id, instrument, side, price, quantity, status, order.trader});
+    }
+
+    static bool valid(const RefOrder& order) {
+        static const std::vector<std::string> instruments = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+        if (std::find(instruments.begin(), instruments.end(), order.instrument) == instruments.end()) return false;
+        if (order.side != 1 && order.side != 2) return false;
+        bool stop = order.order_type == "Stop" || order.order_type == "Stop Limit";
+        if (stop && order.stop_price <= 0) return false;
+        bool priced = order.order_type == "Limit" || order.order_type == "Stop Limit";
+        if (priced && order.price <= 0) return false;
+        if (order.quantity % 10 != 0 || order.quantity < 10 || order.quantity > 1000) return false;
+        return order.display_quantity % 10 == 0 && order.display_quantity >= 0;
+    }
+
+    bool risk_enabled() const {
+        return config_.max_notional > 0 || config_.max_open_quantity > 0 || config_.max_position > 0;
+    }
+
+    // Pre-trade limits; an accepted order's quantity becomes open quantity.
+    bool within_limits(const RefOrder& order) {
+        if (order.trader == 0 || !risk_enabled()) return true;
+        bool priced = order.order_type == "Limit" || order.order_type == "Stop Limit";
+        if (config_.max_notional > 0 && priced && order.price * order.quantity > config_.max_notional) return false;
+        Exposure& exposure = exposure_[{order.trader, order.instrument}];
+        bool buy = order.side == 1;
+        int& open = buy ? exposure.open_buy : exposure.open_sell;
+        if (config_.max_open_quantity > 0 && open + order.quantity > config_.max_open_quantity) return false;
+        if (config_.max_position > 0) {
+            int worst = buy ? exposure.position + exposure.open_buy + order.quantity
+                            : exposure.position - exposure.open_sell - order.quantity;
+            if (std::abs(worst) > config_.max_position) return false;
+        }
+        open += order.quantity;
+        return true;
+    }
+
+    // Fills and cancels from report `first` on close open quantity; fills move the position.
+    void update_exposure(size_t first) {
+        if (!risk_enabled()) return;
+        for (size_t i = first; i < reports_.size(); ++i) {
+            const Report& report = reports_[i];
+            if (report.trader == 0 || report.status < FILL) continue;
+            Exposure& exposure = exposure_[{report.trader, report.instrument}];
+            (report.side == 1 ? exposure.open_buy : exposure.open_sell) -= report.quantity;
+            if (report.status != CANCELLED) exposure.position += report.side == 1 ? report.quantity : -report.quantity;
+        }
+    }
+
+    void submit(RefOrder& order) {
+        size_t first = reports_.size();
+        if (!valid(order) || !within_limits(order)) {
+            report(order, order.price, order.quantity, REJECTED);
+            return;
+        }
+        if (order.order_type == "Stop" || order.order_type == "Stop Limit") {
+            Stops& stops = stops_[order.instrument];
+            bool reached = stops.traded && (order.side == 1 ? stops.last_price >= order.stop_price : stops.last_price <= order.stop_price);
+            if (!reached) {
+                report(order, order.price, order.quantity, NEW);
+                if (order.side == 1) stops.buys.emplace(order.stop_price, order);
+                else stops.sells.emplace(order.stop_price, order);
+                return;
+            }
+            release(order);
+        }
+        match(order, false);
+        while (!triggered_.empty()) {
+            RefOrder stop = triggered_.front();
+            triggered_.pop_front();
+            release(stop);
+            match(stop, true);
+        }
+        update_exposure(first);
+    }
+
+    static void release(RefOrder& order) {
+        order.order_type = order.order_type == "Stop" ? "Market" : "Limit";
+    }
+
+    // Queues the stops the last trade price has reached, nearest stop price first.
+    void trade_at(const std::string& instrument, double price) {
+        Stops& stops = stops_[instrument];
+        stops.last_price = price;
+        stops.traded = true;
+        while (!stops.buys.empty() && stops.buys.begin()->first <= price) {
+            triggered_.push_back(stops.buys.begin()->second);
+            stops.buys.erase(stops.buys.begin());
+        }
+        while (!stops.sells.empty() && stops.sells.begin()->first >= price) {
+            triggered_.push_back(stops.sells.begin()->second);
+            stops.sells.erase(stops.sells.begin());
+        }
+    }
+
+    void match(RefOrder& order, bool acknowledged) {
+        Book& book = books_[order.instrument];
+        if (order.side == 1) match(order, acknowledged, book.asks, book.bids);
+        else match(order, acknowledged, book.bids, book.asks);
+    }
+
+    template <typename Opposite, typename Own>
+    void match(RefOrder& order, bool acknowledged, Opposite& opposite, Own& own) {
+        bool buy = order.side == 1;
+        bool market = order.order_type == "Market";
+        auto crosses = [&](double level) { return market || (buy ? level <= order.price : level >= order.price); };
+
+        // A FOK order is tried on a copy of the levels it could reach and cancelled unless it fills completely.
+        if (order.time_in_force == "FOK") {
+            Opposite reachable;
+            int non_self = 0;
+            for (const auto& level : opposite) {
+                if (!crosses(level.first) || non_self >= order.quantity) break;
+                reachable.insert(level);
+                for (const RestingOrder& resting : level.second) {
+                    if (order.trader == 0 || resting.trader != order.trader) non_self += resting.displayed + resting.hidden;
+                }
+            }
+            RefOrder trial = order;
+            double last_price = 0;
+            sweep(trial, reachable, crosses, nullptr, last_price);
+            if (trial.quantity > 0) {
+                report(order, order.price, order.quantity, CANCELLED);
+                return;
+            }
+        }
+
+        bool may_rest = !market && order.time_in_force.empty();
+        if (may_rest && !acknowledged && (opposite.empty() || !crosses(opposite.begin()->first))) {
+            report(order, order.price, order.quantity, NEW);
+        }
+        double last_price = 0;
+        size_t fills = 0;
+        bool self_trade = sweep(order, opposite, crosses, &fills, last_price);
+
+        if (order.quantity > 0) {
+            if (!self_trade && may_rest) {
+                RestingOrder resting = {order.order_id, order.client_order_id, order.trader, order.quantity, 0, order.display_quantity};
+                if (order.display_quantity > 0 && order.quantity > order.display_quantity) {
+                    resting.displayed = order.display_quantity;
+                    resting.hidden = order.quantity - order.display_quantity;
+                }
+                own[order.price].push_back(resting);
+            } else {
+                report(order, order.price, order.quantity, CANCELLED);
+            }
+        }
+        if (fills > 0) trade_at(order.instrument, last_price);
+    }
+
+    // Trades the order against the levels it crosses, in price then time
+    // priority, and applies self-trade prevention. Reports go out unless
+    // `fills` is null, as for a FOK trial. Returns true if self-trade
+    // prevention cancelled the rest of the order.
+    template <typename Levels, typename Crosses>
+    bool sweep(RefOrder& order, Levels& levels, const Crosses& crosses, size_t* fills, double& last_price) {
+        int resting_side = order.side == 1 ? 2 : 1;
+        for (auto level = levels.begin(); level != levels.end() && order.quantity > 0;) {
+            if (!crosses(level->first)) break;
+            double price = level->first;
+            Level& queue = level->second;
+            bool self_trade = false;
+            for (auto resting = queue.begin(); resting != queue.end();) {
+                auto next = std::next(resting);
+                if (order.trader != 0 && resting->trader == order.trader) {
+                    if (config_.stp != "newest") {
+                        if (fills) report(*resting, order.instrument, resting_side, price, resting->displayed + resting->hidden, CANCELLED);
+                        queue.erase(resting);
+                    }
+                    if (config_.stp != "oldest") {
+                        self_trade = true;
+                        break;
+                    }
+                    resting = next;
+                    continue;
+                }
+                int quantity = std::min(order.quantity, resting->displayed);
+                order.quantity -= quantity;
+                resting->displayed -= quantity;
+                if (fills) {
+                    report(order, price, quantity, order.quantity == 0 ? FILL : PFILL);
+                    report(*resting, order.instrument, resting_side, price, quantity, resting->displayed + resting->hidden == 0 ? FILL : PFILL);
+                    ++*fills;
+                    last_price = price;
+                }
+                if (resting->displayed == 0 && resting->hidden > 0) {
+                    refill(*resting);
+                    queue.splice(queue.end(), queue, resting); // A refilled iceberg goes to the back
+                    if (next == queue.end()) next = resting;
+                } else if (resting->displayed == 0) {
+                    queue.erase(resting);
+                }
+                if (order.quantity == 0) break;
+                resting = next;
+            }
+            level = queue.empty() ? levels.erase(level) : std::next(level);
+            if (self_trade) return true;
+        }
+        return false;
+    }
+
+    static void refill(RestingOrder& order) {
+        int peak = std::min(order.display_quantity, order.hidden);
+        order.displayed = peak;
+        order.hidden -= peak;
+    }
+
+    // Call phase: day limit orders rest without matching.
+    void collect(const RefOrder& order) {
+        if (!valid(order) || order.order_type != "Limit" || !order.time_in_force.empty() || !within_limits(order)) {
+            report(order, order.price, order.quantity, REJECTED);
+            return;
+        }
+        report(order, order.price, order.quantity, NEW);
+        Book& book = books_[order.instrument];
+        RestingOrder resting = {order.order_id, order.client_order_id, order.trader, order.quantity, 0, order.display_quantity};
+        if (order.display_quantity > 0 && order.quantity > order.display_quantity) {
+            resting.displayed = order.display_quantity;
+            resting.hidden = order.quantity - order.display_quantity;
+        }
+        if (order.side == 1) book.bids[order.price].push_back(resting);
+        else book.asks[order.price].push_back(resting);
+    }
+
+    static int open_quantity(const Level& level) {
+        int total = 0;
+        for (const RestingOrder& order : level) total += order.displayed + order.hidden;
+        return total;
+    }
+
+    // Ends a call: each instrument trades at the price with the most
+    // executable volume, then the smallest imbalance, then the lowest price.
+    void uncross() {
+        size_t first = reports_.size();
+        for (auto& entry : books_) {
+            Book& book = entry.second;
+            if (book.bids.empty() || book.asks.empty()) continue;
+
+            std::vector<double> prices;
+            for (const auto& level : book.bids) prices.push_back(level.first);
+            for (const auto& level : book.asks) prices.push_back(level.first);
+            std::sort(prices.begin(), prices.end());
+            prices.erase(std::unique(prices.begin(), prices.end()), prices.end());
+
+            int volume = 0, best_imbalance = 0;
+            double price = 0;
+            for (double candidate : prices) {
+                int demand = 0, supply = 0;
+                for (const auto& level : book.bids) if (level.first >= candidate) demand += open_quantity(level.second);
+                for (const auto& level : book.asks) if (level.first <= candidate) supply += open_quantity(level.second);
+                int executable = std::min(demand, supply);
+                int imbalance = std::abs(demand - supply);
+                if (executable > volume || (executable == volume && executable > 0 && imbalance < best_imbalance)) {
+                    volume = executable;
+                    best_imbalance = imbalance;
+                    price = candidate;
+                }
+            }
+            if (volume == 0) continue;
+
+            auto buy_level = book.bids.begin();
+            auto sell_level = book.asks.begin();
+            auto buy = buy_level->second.begin();
+            auto sell = sell_level->second.begin();
+            while (volume > 0) {
+                int quantity = std::min({volume, buy->displayed, sell->displayed});
+                volume -= quantity;
+                buy->displayed -= quantity;
+                sell->displayed -= quantity;
+                report(*buy, entry.first, 1, price, quantity, buy->displayed + buy->hidden == 0 ? FILL : PFILL);
+                report(*sell, entry.first, 2, price, quantity, sell->displayed + sell->hidden == 0 ? FILL : PFILL);
+                if (buy->displayed == 0) buy = next_auction_order(book.bids, buy_level, buy);
+                if (sell->displayed == 0) sell = next_auction_order(book.asks, sell_level, sell);
+            }
+            remove_filled(book.bids);
+            remove_filled(book.asks);
+            trade_at(entry.first, price);
+        }
+        while (!triggered_.empty()) {
+            RefOrder stop = triggered_.front();
+            triggered_.pop_front();
+            release(stop);
+            match(stop, true);
+        }
+        update_exposure(first);
+    }
+
+    // Steps past an order the auction consumed, refilling it if it is an iceberg.
+    template <typename Levels>
+    Level::iterator next_auction_order(Levels& levels, typename Levels::iterator& level, Level::iterator order) {
+        auto next = std::next(order);
+        if (order->hidden > 0) {
+            refill(*order);
+            level->second.splice(level->second.end(), level->second, order);
+            if (next == level->second.end()) next = order;
+        }
+        if (next == level->second.end() && ++level != levels.end()) next = level->second.begin();
+        return next;
+    }
+
+    template <typename Levels>
+    static void remove_filled(Levels& levels) {
+        for (auto level = levels.begin(); level != levels.end();) {
+            level->second.remove_if([](const RestingOrder& order) { return order.displayed + order.hidden == 0; });
+            level = level->second.empty() ? levels.erase(level) : std::next(level);
+        }
+    }
+
+    StreamConfig config_;
+    std::map<std::string, Book> books_;
+    std::map<std::string, Stops> stops_;
+    std::deque<RefOrder> triggered_;
+    std::map<std::pair<int, std::string>, Exposure> exposure_;
+    std::map<std::string, int> traders_;
+    std::vector<Report> reports_;
+};
+
+// Reads a report file as compared rows: the first seven columns of each line
+// after the header.
+std::vector<std::string> read_report_rows(const std::string& path) {
+    std::vector<std::string> rows;
+    std::ifstream file(path);
+    std::string line;
+    bool header = true;
+    while (std::getline(file, line)) {
+        if (header) {
+            header = false;
+            continue;
+        }
+        if (line.empty()) continue;
+        size_t end = 0;
+        for (int column = 0; column < 7 && end != std::string::npos; ++column) {
+            end = line.find(',', column == 0 ? 0 : end + 1);
+        }
+        rows.push_back(line.substr(0, end));
+    }
+    return rows;
+}
+
+// Returns an empty string if the rows agree, or a description of the first difference.
+std::string first_difference(const std::vector<std::string>& expected, const std::vector<std::string>& actual) {
+    size_t common = std::min(expected.size(), actual.size());
+    for (size_t i = 0; i < common; ++i) {
+        if (expected[i] != actual[i]) {
+            return "report " + std::to_string(i + 1) + ": expected " + expected[i] + ", got " + actual[i];
+        }
+    }
+    if (expected.size() == actual.size()) return "";
+    return "expected " + std::to_string(expected.size()) + " reports, got " + std::to_string(actual.size());
+}
+
+int run_process(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        std::vector<char*> argv;
+        for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// One engine under test: runs an order file under a stream's settings and leaves its reports in `output`.
+struct Contender {
+    std::string name;
+    std::function<bool(const std::string& input, const std::string& output, const StreamConfig& config)> run;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--engine path] [--seed n] [--iterations n] [--orders n]"
+              << " [--bench-orders n] [--basic] [--candidate name=program ...]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    FuzzOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--basic") {
+            options.basic = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--engine") {
+            options.engine = value;
+        } else if (arg == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (arg == "--iterations") {
+            options.iterations = std::stoi(value);
+        } else if (arg == "--orders") {
+            options.orders = std::stoi(value);
+        } else if (arg == "--bench-orders") {
+            options.bench_orders = std::stoi(value);
+        } else if (arg == "--candidate" && value.find('=') != std::string::npos) {
+            options.candidates.emplace_back(value.substr(0, value.find('=')), value.substr(value.find('=') + 1));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    set_fixed_clock(true);
+
+    std::vector<Contender> contenders;
+    contenders.push_back({"library", [](const std::string& input, const std::string& output, const StreamConfig& config) {
+        std::vector<Order> orders = read_orders_from_csv(input);
+        return write_execution_reports_to_csv(output, process_orders(orders, config.auction(), config.engine_config())) == 0;
+    }});
+    std::vector<EngineMode> modes = {
+        {"batch", {}},
+        {"uring", {"--writer", "uring"}},
+        {"pwrite", {"--writer", "pwrite"}},
+        {"huge-pages", {"--writer", "uring", "--huge-pages", "transparent"}},
+    };
+    for (const EngineMode& mode : modes) {
+        contenders.push_back({mode.name, [&options, mode](const std::string& input, const std::string& output, const StreamConfig& config) {
+            std::vector<std::string> args = {options.engine, "--clock", "fixed"};
+            args.insert(args.end(), mode.args.begin(), mode.args.end());
+            std::vector<std::string> session = config.args();
+            args.insert(args.end(), session.begin(), session.end());
+            args.insert(args.end(), {input, output});
+            return run_process(args) == 0;
+        }});
+    }
+    // Candidates only get the files, so they are compared on streams with the default settings.
+    for (const auto& candidate : options.candidates) {
+        std::string program = candidate.second;
+        contenders.push_back({candidate.first, [program](const std::string& input, const std::string& output, const StreamConfig&) {
+            return run_process({program, input, output}) == 0;
+        }});
+    }
+
+    char work_template[] = "/tmp/fuzz.XXXXXX";
+    if (!mkdtemp(work_template)) {
+        std::cerr << "Could not create a work directory." << std::endl;
+        return 1;
+    }
+    fs::path work_dir = work_template;
+    std::string input = (work_dir / "orders.csv").string();
+    std::string output = (work_dir / "reports.csv").string();
+
+    std::cout << "Compared: " << (options.basic ? "limit, market, IOC and FOK orders with invalid fields"
+                                                : "limit, market, IOC, FOK, stop and stop-limit orders, icebergs, traders under "
+                                                  "every self-trade policy, call auctions and risk limits, with invalid fields")
+              << ". Not compared: throttling, whose buckets follow the wall clock, report reasons and transaction times."
+              << std::endl;
+
+    ReferenceMatcher reference;
+    std::vector<size_t> failures(contenders.size(), 0);
+    for (int iteration = 0; iteration < options.iterations; ++iteration) {
+        uint64_t seed = options.seed + iteration;
+        FuzzStream stream = generate_stream(seed, options.orders, options.basic);
+        if (!write_orders(input, stream.orders, options.basic)) {
+            std::cerr << "Could not write " << input << std::endl;
+            return 1;
+        }
+        std::vector<std::string> expected = reference.run(stream);
+
+        for (size_t c = 0; c < contenders.size(); ++c) {
+            std::string detail;
+            try {
+                detail = contenders[c].run(input, output, stream.config) ? first_difference(expected, read_report_rows(output)) : "run failed";
+            } catch (const std::exception& e) {
+                detail = e.what();
+            }
+            if (detail.empty()) continue;
+            // Only the first failing stream of each engine is kept and described.
+            if (failures[c]++ == 0) {
+                std::string kept = "fuzz-" + std::to_string(seed) + ".csv";
+                fs::copy_file(input, kept, fs::copy_options::overwrite_existing);
+                std::cout << "FAIL " << contenders[c].name << " seed " << seed << ": " << detail << " (input kept as " << kept;
+                std::vector<std::string> args = stream.config.args();
+                if (!args.empty()) {
+                    std::cout << ", engine options";
+                    for (const std::string& arg : args) std::cout << " " << arg;
+                }
+                std::cout << ")" << std::endl;
+            }
+        }
+    }
+
+    size_t failed = 0;
+    for (size_t c = 0; c < contenders.size(); ++c) {
+        std::cout << (failures[c] == 0 ? "PASS " : "FAIL ") << contenders[c].name << ": "
+                  << options.iterations - failures[c] << "/" << options.iterations << " streams agree with the reference" << std::endl;
+        failed += failures[c] > 0;
+    }
+
+    if (options.bench_orders > 0) {
+        // The throughput stream uses the default settings, so every contender runs the same session.
+        FuzzStream stream = generate_stream(options.seed, options.bench_orders, options.basic);
+        stream.config = StreamConfig();
+        write_orders(input, stream.orders, options.basic);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> expected = reference.run(stream);
+        double reference_seconds = seconds_since(start);
+
+        std::cout << "\nThroughput over " << options.bench_orders << " orders (seed " << options.seed << "):\n"
+                  << std::left << std::setw(14) << "engine" << std::right << std::setw(10) << "seconds" << std::setw(14)
+                  << "orders/s" << std::setw(14) << "vs reference" << "  agrees" << std::endl;
+        auto print = [&](const std::string& name, double seconds, const std::string& agrees) {
+            std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(3) << std::setw(10)
+                      << seconds << std::setprecision(0) << std::setw(14) << options.bench_orders / seconds
+                      << std::setprecision(2) << std::setw(13) << reference_seconds / seconds << "x  " << agrees << std::endl;
+        };
+        print("reference", reference_seconds, "-");
+        for (const Contender& contender : contenders) {
+            start = std::chrono::steady_clock::now();
+            bool ran = contender.run(input, output, stream.config);
+            double seconds = seconds_since(start);
+            bool agrees = ran && first_difference(expected, read_report_rows(output)).empty();
+            if (!agrees) ++failed;
+            print(contender.name, seconds, agrees ? "yes" : "NO");
+        }
+        std::cout << "The reference is timed on orders already in memory; the library also reads and writes the files, and the"
+                  << " other engines run as processes." << std::endl;
+    }
+
+    fs::remove_all(work_dir);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Binary order-entry protocol spoken between the trader application and the
+// exchange gateway. Every message is a fixed-size frame starting with a
+// MessageHeader; integers are in host byte order since both ends run on the
+// same host.
+
+namespace gateway {
+
+enum MessageType : uint8_t {
+    NEW_ORDER = 1,
+    EXECUTION_REPORT = 2
+};
+
+struct MessageHeader {
+    uint16_t length; // Size of the whole frame, header included
+    uint8_t type;
+    uint8_t reserved;
+};
+
+struct NewOrderMessage {
+    MessageHeader header;
+    char client_order_id[16];
+    char instrument[16];
+    uint8_t side;
+    uint8_t order_type;    // OrderType code from order_types.h
+    uint8_t time_in_force; // TimeInForce code from order_types.h
+    uint8_t reserved;
+    int32_t quantity;
+    int32_t display_quantity; // Iceberg peak, 0 displays the whole quantity
+    double price;
+    double stop_price; // Trigger price of stop and stop-limit orders
+    char trader[16];   // Trader name, empty for none; the exchange assigns its ID
+};
+
+struct ExecutionReportMessage {
+    MessageHeader header;
+    char order_id[16];
+    char client_order_id[16];
+    char instrument[16];
+    int32_t side;
+    int32_t exec_status;
+    int32_t quantity;
+    int32_t reserved;
+    double price;
+    char reason[64];
+    char transaction_time[24];
+};
+
+static_assert(sizeof(NewOrderMessage) == 80, "NewOrderMessage layout changed");
+static_assert(sizeof(ExecutionReportMessage) == 168, "ExecutionReportMessage layout changed");
+
+constexpr uint16_t DEFAULT_PORT = 9000;
+
+// Copies a string into a fixed-size field, truncating and null terminating it.
+template <size_t N>
+inline void copy_field(char (&field)[N], const std::string& value) {
+    size_t len = std::min(value.size(), N - 1);
+    std::memcpy(field, value.data(), len);
+    std::memset(field + len, 0, N - len);
+}
+
+template <size_t N>
+inline std::string read_field(const char (&field)[N]) {
+    return std::string(field, strnlen(field, N));
+}
+
+} // namespace gateway
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <sys/mman.h>
+
+// Backs large engine buffers (the resting order pool, the order ID arena, the
+// input file and the report buffers) with 2MB pages to cut TLB misses. Each
+// allocation falls back on its own: explicit hugetlbfs pages, then a
+// transparent hugepage hint, then ordinary pages.
+
+namespace huge_pages {
+
+enum Mode {
+    OFF,         // Default heap
+    TRANSPARENT, // Anonymous mapping with madvise(MADV_HUGEPAGE)
+    EXPLICIT     // MAP_HUGETLB from the reserved pool, else as TRANSPARENT
+};
+
+constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+// Set once by --huge-pages before anything is allocated.
+inline Mode mode = OFF;
+
+inline bool parse_mode(const std::string& value, Mode& result) {
+    if (value == "off") result = OFF;
+    else if (value == "transparent") result = TRANSPARENT;
+    else if (value == "explicit") result = EXPLICIT;
+    else return false;
+    return true;
+}
+
+// Allocations smaller than a hugepage stay on the heap in every mode.
+inline bool use_mapping(size_t size) {
+    return mode != OFF && size >= HUGE_PAGE_SIZE;
+}
+
+inline size_t mapping_size(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+// Returns memory aligned to at least `alignment` (at most a page). Release it
+// with deallocate() and the same size.
+inline void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    if (!use_mapping(size)) {
+        return ::operator new(size, std::align_val_t(alignment));
+    }
+
+    size_t length = mapping_size(size);
+    if (mode == EXPLICIT) {
+        void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) return memory;
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "No explicit hugepages available, using transparent hugepages." << std::endl;
+            warned = true;
+        }
+    }
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::bad_alloc();
+    // Only a hint: without THP support the mapping keeps 4K pages.
+    madvise(memory, length, MADV_HUGEPAGE);
+    return memory;
+}
+
+inline void deallocate(void* memory, size_t size, size_t alignment = alignof(std::max_align_t)) {
+    if (memory == nullptr) return;
+    if (!use_mapping(size)) {
+        ::operator delete(memory, std::align_val_t(alignment));
+        return;
+    }
+    munmap(memory, mapping_size(size));
+}
+
+// Standard allocator over allocate(), so growing containers move onto
+// hugepages once they pass 2MB.
+template <typename T>
+struct Allocator {
+    using value_type = T;
+
+    Allocator() = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(huge_pages::allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* memory, size_t count) {
+        huge_pages::deallocate(memory, count * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const Allocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const Allocator<U>&) const { return false; }
+};
+
+} // namespace huge_pages
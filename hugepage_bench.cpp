@@ -0,0 +1,184 @@
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Hugepage benchmark: generates a large order file whose orders mostly rest,
+// so the books grow deep, then runs the exchange on it once per --huge-pages
+// mode and reports the engine's data TLB misses, page faults and run time.
+// Counters are opened on the engine process before it execs, as `perf stat`
+// does. Where the hardware TLB events are unavailable (as in many VMs) the
+// page fault count, one per 2MB page instead of one per 4K page, still shows
+// whether hugepages were used.
+
+struct BenchOptions {
+    std::string engine = "./submission";
+    std::string file = "hugepage_bench_orders.csv";
+    std::string output = "hugepage_bench_reports.csv";
+    size_t orders = 2000000;
+    unsigned seed = 7;
+    std::vector<std::string> modes = {"off", "transparent", "explicit"};
+};
+
+// Buys rest below 50 and sells above it on a 0.01 tick, one order in a hundred
+// crosses the whole book, so the book holds most of the file's orders.
+void generate_orders(const BenchOptions& options) {
+    static const char* const instruments[] = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> instrument(0, 4);
+    std::uniform_int_distribution<int> side(1, 2);
+    std::uniform_int_distribution<int> lots(1, 100);
+    std::uniform_int_distribution<int> ticks(1, 4999);
+    std::uniform_int_distribution<int> crossing(0, 99);
+
+    std::ofstream file(options.file);
+    file << "Client Order ID,Instrument,Side,Quantity,Price\n" << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < options.orders; ++i) {
+        int order_side = side(rng);
+        double price = ticks(rng) / 100.0;
+        if (order_side == 2) price += 50.0;
+        if (crossing(rng) == 0) price = order_side == 1 ? 100.0 : 0.01;
+        file << 'c' << i << ',' << instruments[instrument(rng)] << ',' << order_side << ',' << lots(rng) * 10 << ',' << price << '\n';
+    }
+}
+
+int open_counter(pid_t pid, uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1; // Count the writer and stats threads too
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0));
+}
+
+std::string read_counter(int fd) {
+    uint64_t value = 0;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) return "n/a";
+    return std::to_string(value);
+}
+
+struct RunResult {
+    std::string tlb_misses;
+    std::string page_faults;
+    double seconds = 0;
+    int status = -1;
+};
+
+RunResult run_engine(const BenchOptions& options, const std::string& mode) {
+    std::vector<std::string> args = {options.engine, "--clock", "fixed", "--writer", "uring", "--huge-pages", mode, options.file, options.output};
+    int go[2];
+    if (pipe(go) != 0) return {};
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(go[1]);
+        char byte;
+        if (read(go[0], &byte, 1) != 1) _exit(127);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        std::vector<char*> argv;
+        for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    close(go[0]);
+
+    const uint64_t dtlb_load_misses = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    int tlb_fd = open_counter(pid, PERF_TYPE_HW_CACHE, dtlb_load_misses);
+    int fault_fd = open_counter(pid, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+    if (write(go[1], "x", 1) != 1) std::cerr << "Could not start the engine." << std::endl;
+    close(go[1]);
+
+    RunResult result;
+    int status = 0;
+    if (waitpid(pid, &status, 0) == pid && WIFEXITED(status)) result.status = WEXITSTATUS(status);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.tlb_misses = read_counter(tlb_fd);
+    result.page_faults = read_counter(fault_fd);
+    if (tlb_fd >= 0) close(tlb_fd);
+    if (fault_fd >= 0) close(fault_fd);
+    return result;
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--engine path] [--orders n] [--seed n] [--file path] [--output path] [--modes m1,m2,...]" << std::endl;
+}
+
+bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--engine" && has_value) {
+            options.engine = argv[++i];
+        } else if (arg == "--orders" && has_value) {
+            options.orders = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--file" && has_value) {
+            options.file = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            options.output = argv[++i];
+        } else if (arg == "--modes" && has_value) {
+            options.modes.clear();
+            std::string modes = argv[++i];
+            size_t start = 0;
+            while (start <= modes.size()) {
+                size_t comma = modes.find(',', start);
+                if (comma == std::string::npos) comma = modes.size();
+                options.modes.push_back(modes.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        if (!parse_options(argc, argv, options)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception&) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::cout << "Generating " << options.orders << " orders into " << options.file << std::endl;
+    generate_orders(options);
+
+    std::cout << std::left << std::setw(14) << "mode" << std::setw(18) << "dTLB misses" << std::setw(14) << "page faults" << "seconds" << std::endl;
+    int failures = 0;
+    for (const std::string& mode : options.modes) {
+        RunResult result = run_engine(options, mode);
+        if (result.status != 0) {
+            std::cerr << "Engine failed with --huge-pages " << mode << std::endl;
+            ++failures;
+            continue;
+        }
+        std::cout << std::setw(14) << mode << std::setw(18) << result.tlb_misses << std::setw(14) << result.page_faults
+                  << std::fixed << std::setprecision(3) << result.seconds << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1790 @@
+#include "matching_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compressed_io.h"
+#include "huge_pages.h"
+
+// Set by set_fixed_clock().
+static bool use_fixed_clock = false;
+
+void set_fixed_clock(bool fixed) {
+    use_fixed_clock = fixed;
+}
+
+int64_t current_time_ms() {
+    if (use_fixed_clock) {
+        return 0;
+    }
+    auto now = std::chrono::system_clock::now();
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+}
+
+std::string format_time(int64_t time_ms) {
+    if (use_fixed_clock) {
+        return "19700101-000000.000";
+    }
+
+    std::time_t now_c = static_cast<std::time_t>(time_ms / 1000);
+
+    std::tm now_tm = *std::localtime(&now_c);
+
+    std::stringstream ss;
+    ss << std::put_time(&now_tm, "%Y%m%d-%H%M%S");
+    ss << '.' << std::setfill('0') << std::setw(3) << time_ms % 1000;
+
+    return ss.str();
+}
+
+std::string current_time() {
+    return format_time(current_time_ms());
+}
+
+int safe_stoi(const std::string& str) {
+    // Check if the string is empty or contains any non-digit characters
+    if(str.empty() || !std::all_of(str.begin(), str.end(), ::isdigit)) {
+        throw std::invalid_argument("Input string is not a valid integer");
+    }
+    return std::stoi(str);
+}
+
+int getExecutionReportStatus(const std::string& status) {
+    static const std::map<std::string, int> statusMap = {
+        {"New", 0},
+        {"Rejected", 1},
+        {"Fill", 2},
+        {"PFill", 3},
+        {"Cancelled", 4}
+    };
+
+    auto it = statusMap.find(status);
+    if (it != statusMap.end()) {
+        return it->second;
+    } else {
+        return -1;
+    }
+};
+
+ExecutionReport createExecutionReport(const Order& order, const std::string& status, int quantity, double price, const std::string& reason = "", const std::string& timestamp = current_time()) {
+    ExecutionReport report(order.order_id, order.client_order_id, order.instrument, order.side, getExecutionReportStatus(status), quantity, price, reason, timestamp);
+    report.session = order.session;
+    report.trader_id = order.trader_id;
+    return report;
+}
+
+// Append-only storage for the strings of resting orders. A handle is the
+// offset of a 32-bit length followed by the characters. Strings are only read
+// back when a report is built.
+// Handles are 32-bit offsets, so an arena holds at most 4 GiB; adding past
+// that throws instead of letting handles wrap.
+class StringArena {
+public:
+    uint32_t add(const std::string& value) {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        uint32_t handle = next_handle(sizeof(length) + length);
+        data_.resize(handle + sizeof(length) + length);
+        std::memcpy(&data_[handle], &length, sizeof(length));
+        std::memcpy(&data_[handle + sizeof(length)], value.data(), length);
+        return handle;
+    }
+
+    std::string get(uint32_t handle) const {
+        uint32_t length;
+        std::memcpy(&length, &data_[handle], sizeof(length));
+        return std::string(&data_[handle + sizeof(length)], length);
+    }
+
+    // Copies a string from another arena without building a std::string.
+    uint32_t add_from(const StringArena& other, uint32_t handle) {
+        uint32_t length;
+        std::memcpy(&length, &other.data_[handle], sizeof(length));
+        uint32_t copy = next_handle(sizeof(length) + length);
+        data_.insert(data_.end(), &other.data_[handle], &other.data_[handle] + sizeof(length) + length);
+        return copy;
+    }
+
+    // Appends the bytes of another arena; its handles move up by the returned offset.
+    uint32_t append_bytes(const char* bytes, size_t size) {
+        uint32_t offset = next_handle(size);
+        data_.insert(data_.end(), bytes, bytes + size);
+        return offset;
+    }
+
+    const char* bytes() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    bool equals(uint32_t handle, const std::string& value) const {
+        uint32_t length;
+        std::memcpy(&length, &data_[handle], sizeof(length));
+        return length == value.size() && std::memcmp(&data_[handle + sizeof(length)], value.data(), length) == 0;
+    }
+
+private:
+    uint32_t next_handle(size_t added) const {
+        if (added > UINT32_MAX - data_.size()) throw std::length_error("String arena is full: order IDs exceed 4 GiB");
+        return static_cast<uint32_t>(data_.size());
+    }
+
+    std::vector<char, huge_pages::Allocator<char>> data_;
+};
+
+// Status of every order the engine has seen, keyed by client order ID in an
+// open-addressing table with linear probing. The IDs are interned in an arena,
+// so an order costs a 40-byte slot plus its two IDs. A reused client order ID
+// refers to the latest order; reports for the earlier one are ignored.
+class OrderStatusIndex {
+public:
+    bool enabled = false;
+
+    void add(const Order& order, int exec_status = -1) {
+        if (slots_.size() * 7 <= (size_ + 1) * 10) grow();
+        uint32_t hash = hash_id(order.client_order_id);
+        Slot& slot = slots_[find(order.client_order_id, hash)];
+        if (slot.hash == 0) {
+            slot.hash = hash;
+            slot.client_order_id = strings_.add(order.client_order_id);
+            ++size_;
+        }
+        slot.order_id = strings_.add(order.order_id);
+        slot.quantity = order.quantity;
+        slot.open_quantity = order.quantity;
+        slot.filled_quantity = 0;
+        slot.notional = 0;
+        slot.side = static_cast<int8_t>(order.side);
+        slot.exec_status = static_cast<int8_t>(exec_status);
+        slot.instrument = static_cast<int8_t>(stats::instrument_index(order.instrument));
+    }
+
+    void apply(const ExecutionReport& report) {
+        if (slots_.empty()) return;
+        Slot& slot = slots_[find(report.client_order_id, hash_id(report.client_order_id))];
+        if (slot.hash == 0 || !strings_.equals(slot.order_id, report.order_id)) return;
+        slot.exec_status = static_cast<int8_t>(report.exec_status);
+        if (report.exec_status == 1) { // Rejected
+            slot.open_quantity = 0;
+        } else if (report.exec_status >= 2) { // Fill, PFill or Cancelled
+            slot.open_quantity -= report.quantity;
+            if (report.exec_status != 4) {
+                slot.filled_quantity += report.quantity;
+                slot.notional += report.price * report.quantity;
+            }
+        }
+    }
+
+    bool get(const std::string& client_order_id, OrderStatus& status) const {
+        if (slots_.empty()) return false;
+        const Slot& slot = slots_[find(client_order_id, hash_id(client_order_id))];
+        if (slot.hash == 0) return false;
+        status.order_id = strings_.get(slot.order_id);
+        status.instrument = slot.instrument >= 0 ? stats::INSTRUMENTS[slot.instrument] : "";
+        status.side = slot.side;
+        status.exec_status = slot.exec_status;
+        status.quantity = slot.quantity;
+        status.open_quantity = slot.open_quantity;
+        status.filled_quantity = slot.filled_quantity;
+        status.average_price = slot.filled_quantity > 0 ? slot.notional / slot.filled_quantity : 0;
+        return true;
+    }
+
+private:
+    struct Slot {
+        uint32_t hash = 0; // 0 marks an empty slot
+        uint32_t client_order_id = 0; // StringArena handles
+        uint32_t order_id = 0;
+        int32_t quantity = 0;
+        int32_t open_quantity = 0;
+        int32_t filled_quantity = 0;
+        double notional = 0;
+        int8_t side = 0;
+        int8_t exec_status = -1;
+        int8_t instrument = -1;
+    };
+    static_assert(sizeof(Slot) == 40, "Order status slots should stay small");
+
+    static uint32_t hash_id(const std::string& id) {
+        uint32_t hash = 2166136261u; // FNV-1a
+        for (char c : id) hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        return hash != 0 ? hash : 1;
+    }
+
+    // Index of the slot holding `id`, or of the empty slot where it would go.
+    size_t find(const std::string& id, uint32_t hash) const {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot& slot = slots_[i];
+            if (slot.hash == 0 || (slot.hash == hash && strings_.equals(slot.client_order_id, id))) return i;
+        }
+    }
+
+    void grow() {
+        std::vector<Slot, huge_pages::Allocator<Slot>> old(std::max<size_t>(slots_.size() * 2, 1024));
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.hash == 0) continue;
+            size_t i = slot.hash & mask;
+            while (slots_[i].hash != 0) i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<Slot, huge_pages::Allocator<Slot>> slots_;
+    size_t size_ = 0;
+    StringArena strings_;
+};
+
+constexpr uint32_t NO_ORDER = UINT32_MAX;
+
+// A resting order, one cache line. Nodes live in a per-side pool and are linked
+// into their price level's FIFO by pool index. The price is the level's key and
+// the instrument and side are the book's, so none of them are stored here.
+struct alignas(64) OrderNode {
+    uint64_t sequence = 0; // Arrival order within the side; a refilled iceberg takes a new one
+    uint32_t next = NO_ORDER;
+    uint32_t prev = NO_ORDER;
+    uint32_t order_id = 0;        // StringArena handles
+    uint32_t client_order_id = 0;
+    int32_t quantity = 0;         // Displayed quantity
+    int32_t hidden_quantity = 0;  // Iceberg reserve
+    int32_t display_quantity = 0; // Iceberg peak, 0 displays the whole quantity
+    int32_t trader_id = 0;
+    int32_t session = -1;
+};
+
+static_assert(sizeof(OrderNode) == 64, "OrderNode should fill one cache line");
+
+// Resting orders at one price, in arrival (time priority) order.
+struct PriceLevel {
+    uint32_t head = NO_ORDER;
+    uint32_t tail = NO_ORDER;
+    int total_quantity = 0; // Displayed and hidden iceberg quantity
+};
+
+// Price levels of one side of a book, best price first, and the node pool and
+// string arena of its resting orders. Filled nodes go back on a free list.
+template <typename PriceCompare>
+struct BookSide {
+    std::map<double, PriceLevel, PriceCompare> levels;
+    size_t order_count = 0;
+    std::string instrument;
+    int side = 0;
+    std::vector<OrderNode, huge_pages::Allocator<OrderNode>> nodes;
+    uint32_t free_list = NO_ORDER;
+    uint64_t next_sequence = 0;
+    StringArena strings;
+
+    void add(const Order& order) {
+        if (instrument.empty()) {
+            instrument = order.instrument;
+            side = order.side;
+        }
+        uint32_t index = allocate();
+        OrderNode& node = nodes[index];
+        node = OrderNode();
+        node.sequence = next_sequence++;
+        node.order_id = strings.add(order.order_id);
+        node.client_order_id = strings.add(order.client_order_id);
+        node.quantity = order.quantity;
+        node.display_quantity = order.display_quantity;
+        node.trader_id = order.trader_id;
+        node.session = order.session;
+
+        // An iceberg rests with its peak displayed and the rest held in reserve.
+        if (node.display_quantity > 0 && node.quantity > node.display_quantity) {
+            node.hidden_quantity = node.quantity - node.display_quantity;
+            node.quantity = node.display_quantity;
+        }
+
+        PriceLevel& level = levels[order.price];
+        link_back(level, index);
+        level.total_quantity += order.quantity;
+        ++order_count;
+    }
+
+    uint32_t allocate() {
+        if (free_list != NO_ORDER) {
+            uint32_t index = free_list;
+            free_list = nodes[index].next;
+            return index;
+        }
+        nodes.emplace_back();
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    void release(uint32_t index) {
+        nodes[index].next = free_list;
+        free_list = index;
+    }
+
+    void link_back(PriceLevel& level, uint32_t index) {
+        OrderNode& node = nodes[index];
+        node.prev = level.tail;
+        node.next = NO_ORDER;
+        if (level.tail != NO_ORDER) nodes[level.tail].next = index;
+        else level.head = index;
+        level.tail = index;
+    }
+
+    void unlink(PriceLevel& level, uint32_t index) {
+        OrderNode& node = nodes[index];
+        if (node.prev != NO_ORDER) nodes[node.prev].next = node.next;
+        else level.head = node.next;
+        if (node.next != NO_ORDER) nodes[node.next].prev = node.prev;
+        else level.tail = node.prev;
+    }
+
+    ExecutionReport createExecutionReport(uint32_t index, const std::string& status, int quantity, double price,
+                                          const std::string& reason, const std::string& timestamp) const {
+        const OrderNode& node = nodes[index];
+        ExecutionReport report(strings.get(node.order_id), strings.get(node.client_order_id), instrument, side,
+                               getExecutionReportStatus(status), quantity, price, reason, timestamp);
+        report.session = node.session;
+        report.trader_id = node.trader_id;
+        return report;
+    }
+};
+
+using BuySide = BookSide<std::greater<double>>;
+using SellSide = BookSide<std::less<double>>;
+
+// One trade between the incoming order and a resting order. Quantities after
+// the trade are kept so the reports can be built after the sweep. A resting
+// order cancelled by self-trade prevention is recorded as a fill with
+// `cancelled` set and its cancelled quantity in `quantity`.
+struct Fill {
+    uint32_t resting_order; // Node index in the opposite side
+    int quantity;
+    int incoming_remaining;
+    int resting_remaining;
+    double price;
+    bool cancelled = false;
+};
+
+// Refills a consumed iceberg peak from its reserve in place and moves the node
+// to the back of its level, behind the orders already waiting there.
+template <typename Side>
+void refillIceberg(Side& side, PriceLevel& level, uint32_t index) {
+    OrderNode& order = side.nodes[index];
+    int peak = std::min(order.display_quantity, order.hidden_quantity);
+    order.quantity = peak;
+    order.hidden_quantity -= peak;
+    order.sequence = side.next_sequence++;
+    side.unlink(level, index);
+    side.link_back(level, index);
+}
+
+// Consumes whole price levels in one pass: walks each crossing level's FIFO,
+// subtracting quantities and recording fills into `fills`. Filled orders stay
+// linked until removeFilledOrders() so the fill records can refer to them.
+// Returns true if self-trade prevention cancelled the rest of the incoming order.
+template <typename Side>
+bool sweepPriceLevels(Order& incoming_order, double limit_price, Side& opposite_side, std::vector<Fill>& fills, bool isBuyOrder,
+                      SelfTradePolicy self_trade_policy) {
+    // Orders without a trader never match a resting trader ID, which are all >= 0.
+    int self_trader = incoming_order.trader_id != 0 ? incoming_order.trader_id : -1;
+    for (auto level = opposite_side.levels.begin(); level != opposite_side.levels.end() && incoming_order.quantity > 0; ++level) {
+        double price = level->first;
+        if (isBuyOrder ? price > limit_price : price < limit_price) break;
+
+        PriceLevel& price_level = level->second;
+        int remaining = incoming_order.quantity;
+        bool self_trade = false;
+        for (uint32_t index = price_level.head; index != NO_ORDER;) {
+            OrderNode& resting_order = opposite_side.nodes[index];
+            uint32_t next = resting_order.next;
+            if (resting_order.trader_id == self_trader) {
+                stats::add(stats::local().self_trades);
+                if (self_trade_policy != STP_CANCEL_NEWEST) {
+                    int cancelled = resting_order.quantity + resting_order.hidden_quantity;
+                    resting_order.quantity = 0;
+                    resting_order.hidden_quantity = 0;
+                    price_level.total_quantity -= cancelled;
+                    fills.push_back({index, cancelled, remaining, 0, price, true});
+                }
+                if (self_trade_policy != STP_CANCEL_OLDEST) {
+                    self_trade = true;
+                    break;
+                }
+                index = next;
+                continue;
+            }
+            int trade_quantity = std::min(remaining, resting_order.quantity);
+            remaining -= trade_quantity;
+            resting_order.quantity -= trade_quantity;
+            fills.push_back({index, trade_quantity, remaining, resting_order.quantity + resting_order.hidden_quantity, price});
+            if (resting_order.quantity == 0 && resting_order.hidden_quantity > 0) {
+                refillIceberg(opposite_side, price_level, index);
+                if (next == NO_ORDER) next = index; // It was last, so it is also next
+            }
+            if (remaining == 0) break;
+            index = next;
+        }
+        price_level.total_quantity -= incoming_order.quantity - remaining;
+        incoming_order.quantity = remaining;
+        if (self_trade) return true;
+    }
+    return false;
+}
+
+// Fully consumed levels are a prefix of the side, and filled orders a prefix of the first level left.
+template <typename Side>
+void removeFilledOrders(Side& side) {
+    auto level = side.levels.begin();
+    while (level != side.levels.end() && level->second.total_quantity == 0) {
+        for (uint32_t index = level->second.head; index != NO_ORDER;) {
+            uint32_t next = side.nodes[index].next;
+            side.release(index);
+            --side.order_count;
+            index = next;
+        }
+        level = side.levels.erase(level);
+    }
+    if (level != side.levels.end()) {
+        PriceLevel& price_level = level->second;
+        while (price_level.head != NO_ORDER && side.nodes[price_level.head].quantity == 0) {
+            uint32_t index = price_level.head;
+            side.unlink(price_level, index);
+            side.release(index);
+            --side.order_count;
+        }
+    }
+}
+
+// Emits the two execution reports of every fill in the batch as one block.
+template <typename Side>
+void emitFillReports(const Order& incoming_order, const Side& opposite_side, const std::vector<Fill>& fills, std::vector<ExecutionReport>& reports, int instrument,
+                     TradeAnalytics& analytics) {
+    if (fills.empty()) return;
+
+    stats::ThreadCounters& counters = stats::local();
+    int64_t time_ms = current_time_ms();
+    std::string timestamp = format_time(time_ms);
+    for (const Fill& fill : fills) {
+        if (fill.cancelled) {
+            reports.push_back(opposite_side.createExecutionReport(fill.resting_order, "Cancelled", fill.quantity, fill.price, "Self-trade prevented", timestamp));
+            stats::add(counters.cancels);
+            continue;
+        }
+        reports.push_back(createExecutionReport(incoming_order, fill.incoming_remaining == 0 ? "Fill" : "PFill", fill.quantity, fill.price, "", timestamp));
+        reports.push_back(opposite_side.createExecutionReport(fill.resting_order, fill.resting_remaining == 0 ? "Fill" : "PFill", fill.quantity, fill.price, "", timestamp));
+        stats::add(fill.incoming_remaining == 0 ? counters.fills : counters.partial_fills);
+        stats::add(fill.resting_remaining == 0 ? counters.fills : counters.partial_fills);
+        stats::record_trade(instrument, fill.quantity, fill.price);
+        analytics.record(instrument, fill.price, fill.quantity, time_ms);
+    }
+}
+
+// Quantity the incoming order can trade at prices that cross `limit_price`,
+// capped at `needed` so the walk stops as soon as enough liquidity is found.
+// Without a trader, whole levels are summed. With one, the trader's own orders
+// do not count, and unless self-trade prevention cancels only the resting
+// order, the sweep stops at the first of them: only the displayed quantity
+// ahead of it in its level can trade, as refilled icebergs go behind it.
+template <typename Side>
+int availableQuantity(const Side& opposite_side, double limit_price, int needed, bool isBuyOrder, int trader_id,
+                      SelfTradePolicy self_trade_policy) {
+    int available = 0;
+    for (auto level = opposite_side.levels.begin(); level != opposite_side.levels.end() && available < needed; ++level) {
+        if (isBuyOrder ? level->first > limit_price : level->first < limit_price) break;
+        if (trader_id == 0) {
+            available += level->second.total_quantity;
+            continue;
+        }
+        int displayed = 0;
+        int total = 0;
+        for (uint32_t index = level->second.head; index != NO_ORDER; index = opposite_side.nodes[index].next) {
+            const OrderNode& resting_order = opposite_side.nodes[index];
+            if (resting_order.trader_id == trader_id) {
+                if (self_trade_policy != STP_CANCEL_OLDEST) return available + displayed;
+                continue;
+            }
+            displayed += resting_order.quantity;
+            total += resting_order.quantity + resting_order.hidden_quantity;
+        }
+        available += total;
+    }
+    return available;
+}
+
+template <typename Side>
+bool processMatchingOrders(Order& incoming_order, double limit_price, Side& opposite_side, std::vector<Fill>& fills, std::vector<ExecutionReport>& reports, bool isBuyOrder, int instrument,
+                           SelfTradePolicy self_trade_policy, TradeAnalytics& analytics) {
+    fills.clear();
+    bool self_trade = sweepPriceLevels(incoming_order, limit_price, opposite_side, fills, isBuyOrder, self_trade_policy);
+    emitFillReports(incoming_order, opposite_side, fills, reports, instrument, analytics);
+    removeFilledOrders(opposite_side);
+    return self_trade;
+}
+
+// Parked stop orders of one instrument, keyed by stop price so that only the
+// front of each side has to be compared with the last trade price. Orders with
+// the same stop price stay in arrival order.
+struct StopBook {
+    std::multimap<double, Order> buy_stops;                       // Released when the last trade rises to the key
+    std::multimap<double, Order, std::greater<double>> sell_stops; // Released when the last trade falls to the key
+    double last_trade_price = 0;
+    bool traded = false;
+};
+
+// Per-trader exposure in flat arrays indexed by trader ID and instrument index.
+// Open quantity grows when an order is accepted and shrinks as it fills or is
+// cancelled; fills move the net position.
+struct RiskCaches {
+    RiskLimits limits;
+    std::vector<int> open_buy;
+    std::vector<int> open_sell;
+    std::vector<int> position;
+
+    size_t slot(int trader_id, int instrument) {
+        size_t index = static_cast<size_t>(trader_id) * stats::MAX_INSTRUMENTS + instrument;
+        if (index >= position.size()) {
+            size_t size = (static_cast<size_t>(trader_id) + 1) * stats::MAX_INSTRUMENTS * 2;
+            open_buy.resize(size);
+            open_sell.resize(size);
+            position.resize(size);
+        }
+        return index;
+    }
+};
+
+// Token buckets in flat arrays indexed by trader ID, or a single bucket at
+// index 0. A bucket holds up to `burst` tokens, refills at `rate` per second
+// and gives one token per order.
+struct TokenBuckets {
+    double rate = 0;
+    double burst = 1;
+    std::vector<double> tokens;
+    std::vector<int64_t> updated_ns;
+
+    // Refills bucket `index` up to `now_ns`; returns true if it holds a token.
+    bool available(size_t index, int64_t now_ns) {
+        if (index >= tokens.size()) {
+            tokens.resize(index + 1, burst);
+            updated_ns.resize(index + 1, now_ns);
+        }
+        tokens[index] = std::min(burst, tokens[index] + (now_ns - updated_ns[index]) * 1e-9 * rate);
+        updated_ns[index] = now_ns;
+        return tokens[index] >= 1;
+    }
+
+    // Time until bucket `index` holds a token again; call after available().
+    int64_t refill_ns(size_t index) const {
+        return tokens[index] >= 1 ? 0 : static_cast<int64_t>((1 - tokens[index]) * 1e9 / rate) + 1;
+    }
+};
+
+struct Throttle {
+    ThrottleLimits limits;
+    TokenBuckets traders;
+    TokenBuckets global;
+    std::vector<std::deque<Order>> held; // Held orders per trader ID, oldest first
+    std::deque<int> waiting;             // Traders with held orders, in round-robin order
+    size_t held_count = 0;
+
+    void configure(const ThrottleLimits& new_limits) {
+        limits = new_limits;
+        traders.rate = limits.trader_rate;
+        traders.burst = std::max(1.0, limits.trader_burst > 0 ? limits.trader_burst : limits.trader_rate);
+        global.rate = limits.global_rate;
+        global.burst = std::max(1.0, limits.global_burst > 0 ? limits.global_burst : limits.global_rate);
+    }
+
+    bool global_available(int64_t now_ns) { return global.rate <= 0 || global.available(0, now_ns); }
+
+    bool trader_available(int trader_id, int64_t now_ns) {
+        return trader_id == 0 || traders.rate <= 0 || traders.available(trader_id, now_ns);
+    }
+
+    void take(int trader_id) {
+        if (global.rate > 0) global.tokens[0] -= 1;
+        if (trader_id != 0 && traders.rate > 0) traders.tokens[trader_id] -= 1;
+    }
+
+    bool holding(int trader_id) const {
+        return static_cast<size_t>(trader_id) < held.size() && !held[trader_id].empty();
+    }
+
+    void hold(const Order& order) {
+        if (static_cast<size_t>(order.trader_id) >= held.size()) held.resize(order.trader_id + 1);
+        if (held[order.trader_id].empty()) waiting.push_back(order.trader_id);
+        held[order.trader_id].push_back(order);
+        ++held_count;
+    }
+};
+
+int64_t throttle_clock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct OrderBooks {
+    OrderRules rules;
+    SelfTradePolicy self_trade_policy = STP_CANCEL_NEWEST;
+    RiskCaches risk;
+    Throttle throttle;
+    TradeAnalytics analytics;
+    OrderStatusIndex order_status;
+    std::map<std::string, BuySide> buy_order_books;
+    std::map<std::string, SellSide> sell_order_books;
+    std::map<std::string, StopBook> stop_books;
+    std::deque<Order> triggered_stops; // Released stops waiting to be matched, in release order
+    std::vector<Fill> fills; // Reused fill batch
+    int loaded_trader_count = 0; // Highest trader ID in a loaded snapshot
+};
+
+bool isStopOrder(const Order& order) {
+    return order.order_type == ORDER_TYPE_STOP || order.order_type == ORDER_TYPE_STOP_LIMIT;
+}
+
+bool stopTriggered(const Order& order, const StopBook& stops) {
+    return stops.traded && (order.side == 1 ? stops.last_trade_price >= order.stop_price : stops.last_trade_price <= order.stop_price);
+}
+
+// A released stop trades as a market order, a released stop-limit as a limit order.
+void releaseStop(Order& order) {
+    order.order_type = order.order_type == ORDER_TYPE_STOP ? ORDER_TYPE_MARKET : ORDER_TYPE_LIMIT;
+    stats::add(stats::local().stop_triggers);
+}
+
+// Moves every stop the last trade price has reached to the release queue: the
+// nearest stop price first, then arrival order.
+void collectTriggeredStops(StopBook& stops, std::deque<Order>& triggered) {
+    while (!stops.buy_stops.empty() && stops.buy_stops.begin()->first <= stops.last_trade_price) {
+        triggered.push_back(std::move(stops.buy_stops.begin()->second));
+        stops.buy_stops.erase(stops.buy_stops.begin());
+    }
+    while (!stops.sell_stops.empty() && stops.sell_stops.begin()->first >= stops.last_trade_price) {
+        triggered.push_back(std::move(stops.sell_stops.begin()->second));
+        stops.sell_stops.erase(stops.sell_stops.begin());
+    }
+}
+
+// Matches a validated order against the opposite side, then rests what is left
+// of a limit order or cancels it for IOC, FOK and market orders, which never rest.
+template <typename OppositeSide, typename OwnSide>
+void matchIncomingOrder(Order& incoming_order, OppositeSide& opposite_side, OwnSide& own_side, OrderBooks& books,
+                        std::vector<ExecutionReport>& execution_reports, bool isBuyOrder, int instrument, bool acknowledged) {
+    stats::ThreadCounters& counters = stats::local();
+    bool is_market = incoming_order.order_type == ORDER_TYPE_MARKET;
+    bool may_rest = !is_market && incoming_order.time_in_force == TIME_IN_FORCE_DAY;
+    double limit_price = !is_market ? incoming_order.price
+                       : isBuyOrder ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+
+    if (incoming_order.time_in_force == TIME_IN_FORCE_FOK
+        && availableQuantity(opposite_side, limit_price, incoming_order.quantity, isBuyOrder, incoming_order.trader_id,
+                             books.self_trade_policy) < incoming_order.quantity) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Cancelled", incoming_order.quantity, incoming_order.price, "FOK order could not be fully filled"));
+        stats::add(counters.cancels);
+        return;
+    }
+
+    if (may_rest && !acknowledged && (opposite_side.levels.empty() || (isBuyOrder ? opposite_side.levels.begin()->first > limit_price : opposite_side.levels.begin()->first < limit_price))) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "New", incoming_order.quantity, incoming_order.price));
+        stats::add(counters.new_orders);
+    }
+    bool self_trade = processMatchingOrders(incoming_order, limit_price, opposite_side, books.fills, execution_reports, isBuyOrder, instrument,
+                                            books.self_trade_policy, books.analytics);
+    stats::record_book_depth(instrument, isBuyOrder ? 2 : 1, opposite_side.order_count);
+
+    if (incoming_order.quantity > 0) {
+        if (self_trade) {
+            execution_reports.push_back(createExecutionReport(incoming_order, "Cancelled", incoming_order.quantity, incoming_order.price, "Self-trade prevented"));
+            stats::add(counters.cancels);
+        } else if (may_rest) {
+            own_side.add(incoming_order);
+            stats::record_book_depth(instrument, isBuyOrder ? 1 : 2, own_side.order_count);
+        } else {
+            execution_reports.push_back(createExecutionReport(incoming_order, "Cancelled", incoming_order.quantity, incoming_order.price, "Unfilled quantity cancelled"));
+            stats::add(counters.cancels);
+        }
+    }
+}
+
+// Matches an order and, if it traded, queues the stops its last trade price reached.
+// `acknowledged` is set for released stops, whose New report was sent when they were parked.
+void matchOrder(Order& order, OrderBooks& books, std::vector<ExecutionReport>& execution_reports, bool acknowledged) {
+    int instrument = stats::instrument_index(order.instrument);
+    books.fills.clear();
+    if (order.side == 1) { // Buy order
+        matchIncomingOrder(order, books.sell_order_books[order.instrument], books.buy_order_books[order.instrument],
+                           books, execution_reports, true, instrument, acknowledged);
+    } else if (order.side == 2) { // Sell order
+        matchIncomingOrder(order, books.buy_order_books[order.instrument], books.sell_order_books[order.instrument],
+                           books, execution_reports, false, instrument, acknowledged);
+    }
+
+    // Self-trade cancels are in the batch too, but only trades set the last price.
+    for (auto fill = books.fills.rbegin(); fill != books.fills.rend(); ++fill) {
+        if (fill->cancelled) continue;
+        StopBook& stops = books.stop_books[order.instrument];
+        stops.last_trade_price = fill->price;
+        stops.traded = true;
+        collectTriggeredStops(stops, books.triggered_stops);
+        break;
+    }
+}
+
+// Released stops are matched from a queue rather than recursively, so a
+// cascade of triggers runs in release order with constant stack depth.
+void matchTriggeredStops(OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    while (!books.triggered_stops.empty()) {
+        Order triggered = std::move(books.triggered_stops.front());
+        books.triggered_stops.pop_front();
+        releaseStop(triggered);
+        matchOrder(triggered, books, execution_reports, true);
+    }
+}
+
+// Pre-trade risk check against the trader's cached exposure. An accepted
+// order's quantity is added to the trader's open quantity. Orders without a
+// trader, and market and stop orders for the notional limit, are not checked.
+bool checkRisk(const Order& order, RiskCaches& risk, std::string& reason) {
+    if (order.trader_id == 0 || !risk.limits.enabled()) return true;
+
+    bool priced = order.order_type == ORDER_TYPE_LIMIT || order.order_type == ORDER_TYPE_STOP_LIMIT;
+    if (risk.limits.max_notional > 0 && priced && order.price * order.quantity > risk.limits.max_notional) {
+        reason = "Order notional exceeds limit for order " + order.client_order_id;
+        return false;
+    }
+
+    size_t slot = risk.slot(order.trader_id, stats::instrument_index(order.instrument));
+    bool buy = order.side == 1;
+    int& open = buy ? risk.open_buy[slot] : risk.open_sell[slot];
+    if (risk.limits.max_open_quantity > 0 && open + order.quantity > risk.limits.max_open_quantity) {
+        reason = "Open quantity limit exceeded for order " + order.client_order_id;
+        return false;
+    }
+    if (risk.limits.max_position > 0) {
+        int worst_position = buy ? risk.position[slot] + risk.open_buy[slot] + order.quantity
+                                 : risk.position[slot] - risk.open_sell[slot] - order.quantity;
+        if (std::abs(worst_position) > risk.limits.max_position) {
+            reason = "Position limit exceeded for order " + order.client_order_id;
+            return false;
+        }
+    }
+    open += order.quantity;
+    return true;
+}
+
+// Applies the fills and cancels among the reports from `first` on to the
+// traders' open quantities and positions.
+void updateRiskCaches(RiskCaches& risk, const std::vector<ExecutionReport>& reports, size_t first) {
+    if (!risk.limits.enabled()) return;
+    for (size_t i = first; i < reports.size(); ++i) {
+        const ExecutionReport& report = reports[i];
+        if (report.trader_id == 0 || report.exec_status < 2) continue; // New and Rejected reports do not change exposure
+
+        size_t slot = risk.slot(report.trader_id, stats::instrument_index(report.instrument));
+        bool buy = report.side == 1;
+        (buy ? risk.open_buy[slot] : risk.open_sell[slot]) -= report.quantity;
+        if (report.exec_status != 4) { // Fill or PFill
+            risk.position[slot] += buy ? report.quantity : -report.quantity;
+        }
+    }
+}
+
+void process_admitted_order(Order& incoming_order, OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    stats::ThreadCounters& counters = stats::local();
+    size_t first_report = execution_reports.size();
+
+    std::string validationReason;
+    stats::Reject reject;
+    if (!validate_order(incoming_order, validationReason, &reject, books.rules)) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price, validationReason));
+        stats::add(counters.rejects[reject]);
+        return;
+    }
+    if (!checkRisk(incoming_order, books.risk, validationReason)) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price, validationReason));
+        stats::add(counters.rejects[stats::REJECT_RISK]);
+        return;
+    }
+
+    if (isStopOrder(incoming_order)) {
+        StopBook& stops = books.stop_books[incoming_order.instrument];
+        if (!stopTriggered(incoming_order, stops)) {
+            execution_reports.push_back(createExecutionReport(incoming_order, "New", incoming_order.quantity, incoming_order.price));
+            stats::add(counters.new_orders);
+            if (incoming_order.side == 1) stops.buy_stops.emplace(incoming_order.stop_price, incoming_order);
+            else stops.sell_stops.emplace(incoming_order.stop_price, incoming_order);
+            return;
+        }
+        releaseStop(incoming_order); // The market is already through the stop price
+    }
+    matchOrder(incoming_order, books, execution_reports, false);
+    matchTriggeredStops(books, execution_reports);
+    updateRiskCaches(books.risk, execution_reports, first_report);
+}
+
+// Matches held orders while the buckets have tokens: one order per trader per
+// turn, so a trader with a long backlog cannot starve the others.
+void releaseHeldOrders(OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    Throttle& throttle = books.throttle;
+    if (throttle.held_count == 0) return;
+    int64_t now_ns = throttle_clock_ns();
+    for (size_t misses = 0; !throttle.waiting.empty() && misses < throttle.waiting.size();) {
+        if (!throttle.global_available(now_ns)) break;
+        int trader_id = throttle.waiting.front();
+        throttle.waiting.pop_front();
+        if (!throttle.trader_available(trader_id, now_ns)) {
+            throttle.waiting.push_back(trader_id);
+            ++misses;
+            continue;
+        }
+        misses = 0;
+        throttle.take(trader_id);
+        std::deque<Order>& held = throttle.held[trader_id];
+        Order order = std::move(held.front());
+        held.pop_front();
+        --throttle.held_count;
+        if (!held.empty()) throttle.waiting.push_back(trader_id);
+        process_admitted_order(order, books, execution_reports);
+    }
+    stats::record_queue(stats::QUEUE_HELD_ORDERS, throttle.held_count);
+}
+
+// Time until a held order could be released.
+int64_t heldOrderWaitNs(Throttle& throttle) {
+    int64_t now_ns = throttle_clock_ns();
+    if (!throttle.global_available(now_ns)) return throttle.global.refill_ns(0);
+    int64_t wait_ns = INT64_MAX;
+    for (int trader_id : throttle.waiting) {
+        wait_ns = std::min(wait_ns, throttle.trader_available(trader_id, now_ns) ? 0 : throttle.traders.refill_ns(trader_id));
+    }
+    return wait_ns;
+}
+
+// Takes the order's tokens, or rejects or holds it. A trader's orders are
+// held behind its earlier held orders even when there are tokens, so that
+// they keep their order.
+bool admitOrder(Order& incoming_order, OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    Throttle& throttle = books.throttle;
+    int64_t now_ns = throttle_clock_ns();
+    bool behind_held = throttle.limits.hold && throttle.holding(incoming_order.trader_id);
+    if (!behind_held && throttle.global_available(now_ns) && throttle.trader_available(incoming_order.trader_id, now_ns)) {
+        throttle.take(incoming_order.trader_id);
+        return true;
+    }
+    if (throttle.limits.hold) {
+        throttle.hold(incoming_order);
+        stats::record_queue(stats::QUEUE_HELD_ORDERS, throttle.held_count);
+        return false;
+    }
+    execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price,
+                                                      "Message rate limit exceeded for order " + incoming_order.client_order_id));
+    stats::add(stats::local().rejects[stats::REJECT_THROTTLE]);
+    return false;
+}
+
+// Continuous trading: throttles, validates and matches an order. Orders
+// released by the throttle go first, as they arrived earlier.
+void process_order(Order& incoming_order, OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    stats::add(stats::local().orders_in);
+    if (books.throttle.limits.enabled() || books.throttle.held_count > 0) {
+        releaseHeldOrders(books, execution_reports);
+        if (!admitOrder(incoming_order, books, execution_reports)) return;
+    }
+    process_admitted_order(incoming_order, books, execution_reports);
+}
+
+// Call phase: validates an order and rests it without matching.
+void collect_order(Order& incoming_order, OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    stats::ThreadCounters& counters = stats::local();
+    stats::add(counters.orders_in);
+
+    std::string validationReason;
+    stats::Reject reject;
+    if (!validate_order(incoming_order, validationReason, &reject, books.rules)) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price, validationReason));
+        stats::add(counters.rejects[reject]);
+        return;
+    }
+    if (incoming_order.order_type != ORDER_TYPE_LIMIT || incoming_order.time_in_force != TIME_IN_FORCE_DAY) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price,
+                                                          "Only day limit orders are accepted in an auction call for order " + incoming_order.client_order_id));
+        stats::add(counters.rejects[stats::REJECT_ORDER_TYPE]);
+        return;
+    }
+    if (!checkRisk(incoming_order, books.risk, validationReason)) {
+        execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price, validationReason));
+        stats::add(counters.rejects[stats::REJECT_RISK]);
+        return;
+    }
+
+    execution_reports.push_back(createExecutionReport(incoming_order, "New", incoming_order.quantity, incoming_order.price));
+    stats::add(counters.new_orders);
+    int instrument = stats::instrument_index(incoming_order.instrument);
+    if (incoming_order.side == 1) {
+        BuySide& buys = books.buy_order_books[incoming_order.instrument];
+        buys.add(incoming_order);
+        stats::record_book_depth(instrument, 1, buys.order_count);
+    } else {
+        SellSide& sells = books.sell_order_books[incoming_order.instrument];
+        sells.add(incoming_order);
+        stats::record_book_depth(instrument, 2, sells.order_count);
+    }
+}
+
+// Cumulative demand and supply over the price points of a crossed book, lowest
+// price first: demand[i] is the buy quantity priced at or above prices[i],
+// supply[i] the sell quantity priced at or below it.
+struct AuctionCurves {
+    std::vector<double> prices;
+    std::vector<int> demand;
+    std::vector<int> supply;
+};
+
+// Returns the index of the uncrossing price, or -1 if the book does not cross.
+// It is the price point with the most executable volume, then the smallest
+// imbalance between demand and supply, then the lowest price.
+int findUncrossingPrice(const BuySide& buys, const SellSide& sells, AuctionCurves& curves, int& volume) {
+    std::vector<double>& prices = curves.prices;
+    prices.clear();
+    for (const auto& level : sells.levels) prices.push_back(level.first);
+    size_t sell_points = prices.size();
+    for (auto level = buys.levels.rbegin(); level != buys.levels.rend(); ++level) prices.push_back(level->first);
+    std::inplace_merge(prices.begin(), prices.begin() + sell_points, prices.end());
+    prices.erase(std::unique(prices.begin(), prices.end()), prices.end());
+
+    size_t n = prices.size();
+    curves.demand.assign(n, 0);
+    curves.supply.assign(n, 0);
+    int cumulative = 0;
+    auto sell = sells.levels.begin();
+    for (size_t i = 0; i < n; ++i) {
+        if (sell != sells.levels.end() && sell->first == prices[i]) cumulative += (sell++)->second.total_quantity;
+        curves.supply[i] = cumulative;
+    }
+    cumulative = 0;
+    auto buy = buys.levels.begin();
+    for (size_t i = n; i-- > 0;) {
+        if (buy != buys.levels.end() && buy->first == prices[i]) cumulative += (buy++)->second.total_quantity;
+        curves.demand[i] = cumulative;
+    }
+
+    const int* demand = curves.demand.data();
+    const int* supply = curves.supply.data();
+    volume = 0;
+    for (size_t i = 0; i < n; ++i) {
+        volume = std::max(volume, std::min(demand[i], supply[i]));
+    }
+    if (volume == 0) return -1;
+
+    int best = -1;
+    int best_imbalance = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (std::min(demand[i], supply[i]) != volume) continue;
+        int imbalance = std::abs(demand[i] - supply[i]);
+        if (best < 0 || imbalance < best_imbalance) {
+            best = static_cast<int>(i);
+            best_imbalance = imbalance;
+        }
+    }
+    return best;
+}
+
+// Moves past a consumed order during an uncross: refills it if it is an
+// iceberg, then steps to the next order in the level or the next level.
+template <typename Side, typename LevelIterator>
+uint32_t nextAuctionOrder(Side& side, LevelIterator& level, uint32_t index) {
+    uint32_t next = side.nodes[index].next;
+    if (side.nodes[index].hidden_quantity > 0) {
+        refillIceberg(side, level->second, index);
+        if (next == NO_ORDER) next = index;
+    }
+    if (next == NO_ORDER && ++level != side.levels.end()) next = level->second.head;
+    return next;
+}
+
+// Trades `volume` at the uncrossing price, pairing buy and sell orders in price
+// then time priority. Icebergs are refilled and requeued as in continuous trading.
+void executeAuction(BuySide& buys, SellSide& sells, double price, int volume, std::vector<ExecutionReport>& reports, int instrument,
+                    TradeAnalytics& analytics) {
+    stats::ThreadCounters& counters = stats::local();
+    int64_t time_ms = current_time_ms();
+    std::string timestamp = format_time(time_ms);
+    auto buy_level = buys.levels.begin();
+    auto sell_level = sells.levels.begin();
+    uint32_t buy_index = buy_level->second.head;
+    uint32_t sell_index = sell_level->second.head;
+
+    while (volume > 0) {
+        OrderNode& buy = buys.nodes[buy_index];
+        OrderNode& sell = sells.nodes[sell_index];
+        int trade_quantity = std::min({volume, buy.quantity, sell.quantity});
+        volume -= trade_quantity;
+        buy.quantity -= trade_quantity;
+        sell.quantity -= trade_quantity;
+        buy_level->second.total_quantity -= trade_quantity;
+        sell_level->second.total_quantity -= trade_quantity;
+
+        int buy_remaining = buy.quantity + buy.hidden_quantity;
+        int sell_remaining = sell.quantity + sell.hidden_quantity;
+        reports.push_back(buys.createExecutionReport(buy_index, buy_remaining == 0 ? "Fill" : "PFill", trade_quantity, price, "", timestamp));
+        reports.push_back(sells.createExecutionReport(sell_index, sell_remaining == 0 ? "Fill" : "PFill", trade_quantity, price, "", timestamp));
+        stats::add(buy_remaining == 0 ? counters.fills : counters.partial_fills);
+        stats::add(sell_remaining == 0 ? counters.fills : counters.partial_fills);
+        stats::record_trade(instrument, trade_quantity, price);
+        analytics.record(instrument, price, trade_quantity, time_ms);
+
+        if (buy.quantity == 0) {
+            buy_index = nextAuctionOrder(buys, buy_level, buy_index);
+        }
+        if (sell.quantity == 0) {
+            sell_index = nextAuctionOrder(sells, sell_level, sell_index);
+        }
+    }
+    removeFilledOrders(buys);
+    removeFilledOrders(sells);
+}
+
+// Ends a call: uncrosses every instrument's book and releases the stops its
+// auction price reached.
+void uncross_auction(OrderBooks& books, std::vector<ExecutionReport>& execution_reports) {
+    size_t first_report = execution_reports.size();
+    AuctionCurves curves;
+    for (auto& entry : books.buy_order_books) {
+        auto sells = books.sell_order_books.find(entry.first);
+        if (sells == books.sell_order_books.end()) continue;
+
+        int volume = 0;
+        int index = findUncrossingPrice(entry.second, sells->second, curves, volume);
+        if (index < 0) continue;
+
+        double price = curves.prices[index];
+        int instrument = stats::instrument_index(entry.first);
+        executeAuction(entry.second, sells->second, price, volume, execution_reports, instrument, books.analytics);
+        stats::record_book_depth(instrument, 1, entry.second.order_count);
+        stats::record_book_depth(instrument, 2, sells->second.order_count);
+
+        StopBook& stops = books.stop_books[entry.first];
+        stops.last_trade_price = price;
+        stops.traded = true;
+        collectTriggeredStops(stops, books.triggered_stops);
+    }
+    matchTriggeredStops(books, execution_reports);
+    updateRiskCaches(books.risk, execution_reports, first_report);
+}
+
+// Runs the order at `index` in its session phase: the opening call, continuous
+// trading or the closing call. The last order of a call triggers the uncross.
+void process_session_order(std::vector<Order>& orders, size_t index, const AuctionSchedule& auction, OrderBooks& books,
+                           std::vector<ExecutionReport>& execution_reports) {
+    size_t open_end = std::min(auction.open_orders, orders.size());
+    size_t close_start = std::max(open_end, orders.size() - std::min(auction.close_orders, orders.size()));
+    if (index >= open_end && index < close_start) {
+        process_order(orders[index], books, execution_reports);
+        return;
+    }
+    collect_order(orders[index], books, execution_reports);
+    if (index + 1 == open_end || index + 1 == orders.size()) {
+        uncross_auction(books, execution_reports);
+    }
+}
+
+std::vector<ExecutionReport> process_orders(std::vector<Order>& orders, const AuctionSchedule& auction, const EngineConfig& config) {
+    std::vector<ExecutionReport> execution_reports;
+    MatchingEngine engine(config);
+    engine.run(orders, auction, execution_reports);
+    ReportSpan released = engine.release_held(true);
+    execution_reports.insert(execution_reports.end(), released.begin(), released.end());
+    return execution_reports;
+}
+
+
+std::string generate_order_id(int& count) {
+    return "ord" + std::to_string(++count);
+}
+
+bool validate_order(const Order& order, std::string& reason, stats::Reject* reject, const OrderRules& rules) {
+    static const std::set<std::string> valid_instruments = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+    
+    if (valid_instruments.find(order.instrument) == valid_instruments.end()) {
+        reason = "Invalid instrument: " + order.instrument;
+        if (reject) *reject = stats::REJECT_INSTRUMENT;
+        return false;
+    }
+
+    if (order.side != 1 && order.side != 2) {
+        reason = "Invalid side for order " + order.client_order_id + ": " + std::to_string(order.side);
+        if (reject) *reject = stats::REJECT_SIDE;
+        return false;
+    }
+
+    if (order.order_type < ORDER_TYPE_LIMIT || order.order_type > ORDER_TYPE_STOP_LIMIT) {
+        reason = "Invalid order type for order " + order.client_order_id;
+        if (reject) *reject = stats::REJECT_ORDER_TYPE;
+        return false;
+    }
+
+    if (!(rules.order_types & (1u << order.order_type))) {
+        reason = "Order type not accepted for order " + order.client_order_id;
+        if (reject) *reject = stats::REJECT_ORDER_TYPE;
+        return false;
+    }
+
+    if (order.time_in_force != TIME_IN_FORCE_DAY && order.time_in_force != TIME_IN_FORCE_IOC && order.time_in_force != TIME_IN_FORCE_FOK) {
+        reason = "Invalid time in force for order " + order.client_order_id;
+        if (reject) *reject = stats::REJECT_ORDER_TYPE;
+        return false;
+    }
+
+    if (isStopOrder(order) && order.stop_price <= 0) {
+        reason = "Invalid stop price for order " + order.client_order_id + ": " + std::to_string(order.stop_price);
+        if (reject) *reject = stats::REJECT_PRICE;
+        return false;
+    }
+
+    // Market and stop orders take whatever price the book offers, so their price is not checked.
+    if ((order.order_type == ORDER_TYPE_LIMIT || order.order_type == ORDER_TYPE_STOP_LIMIT) && order.price <= 0) {
+        reason = "Invalid price for order " + order.client_order_id + ": " + std::to_string(order.price);
+        if (reject) *reject = stats::REJECT_PRICE;
+        return false;
+    }
+
+    if ((order.order_type == ORDER_TYPE_LIMIT || order.order_type == ORDER_TYPE_STOP_LIMIT) && rules.tick_size > 0) {
+        double ticks = order.price / rules.tick_size;
+        if (std::fabs(ticks - std::round(ticks)) > 1e-9 * std::max(1.0, ticks)) {
+            reason = "Price is not a multiple of the tick size for order " + order.client_order_id + ": " + std::to_string(order.price);
+            if (reject) *reject = stats::REJECT_PRICE;
+            return false;
+        }
+    }
+
+    if (order.quantity % rules.lot_size != 0 || order.quantity < rules.min_quantity || order.quantity > rules.max_quantity) {
+        reason = "Invalid quantity for order " + order.client_order_id + ": " + std::to_string(order.quantity);
+        if (reject) *reject = stats::REJECT_QUANTITY;
+        return false;
+    }
+
+    if (order.display_quantity % rules.lot_size != 0 || order.display_quantity < 0) {
+        reason = "Invalid display quantity for order " + order.client_order_id + ": " + std::to_string(order.display_quantity);
+        if (reject) *reject = stats::REJECT_QUANTITY;
+        return false;
+    }
+
+    reason = "Order " + order.client_order_id + " is valid.";
+    return true;
+}
+
+// An input file read whole into one buffer, which --huge-pages backs with 2MB pages.
+class InputBuffer {
+public:
+    explicit InputBuffer(int fd) {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("Could not open file");
+        }
+        capacity_ = static_cast<size_t>(info.st_size);
+        data_ = static_cast<char*>(huge_pages::allocate(capacity_));
+        while (size_ < capacity_) {
+            ssize_t count = read(fd, data_ + size_, capacity_ - size_);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) break;
+            size_ += static_cast<size_t>(count);
+        }
+        close(fd);
+    }
+
+    ~InputBuffer() { huge_pages::deallocate(data_, capacity_); }
+
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // Reads the next line without its newline, like std::getline.
+    bool next_line(std::string& line) {
+        if (position_ >= size_) return false;
+        const char* start = data_ + position_;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', size_ - position_));
+        size_t length = newline ? static_cast<size_t>(newline - start) : size_ - position_;
+        line.assign(start, length);
+        position_ += length + 1;
+        return true;
+    }
+
+private:
+    char* data_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t position_ = 0;
+};
+
+template <typename LineSource>
+std::vector<Order> parse_orders(LineSource& file) {
+    std::vector<Order> orders;
+    int order_count = 0;
+
+    std::string line;
+    bool is_header = true; 
+    int order_type_column = -1;
+    int time_in_force_column = -1;
+    int stop_price_column = -1;
+    int display_quantity_column = -1;
+    int trader_column = -1;
+    TraderIds traders;
+    while (file.next_line(line)) {
+        if (is_header) {
+            // The first five columns are positional; optional columns are found by name.
+            std::stringstream header(line);
+            std::string name;
+            for (int column = 0; std::getline(header, name, ','); ++column) {
+                if (name == ORDER_TYPE_COLUMN) order_type_column = column;
+                if (name == TIME_IN_FORCE_COLUMN) time_in_force_column = column;
+                if (name == STOP_PRICE_COLUMN) stop_price_column = column;
+                if (name == DISPLAY_QUANTITY_COLUMN) display_quantity_column = column;
+                if (name == TRADER_COLUMN) trader_column = column;
+            }
+            is_header = false;
+            continue;
+        }
+        if (line.empty()) continue;
+
+        std::stringstream ss(line);
+        std::vector<std::string> row;
+        std::string value;
+
+        while (std::getline(ss, value, ',')) {
+            row.push_back(value);
+        }
+
+        if (row.size() >= 5) {
+            try {
+               
+                int side = safe_stoi(row[2]);
+                int quantity = safe_stoi(row[3]);
+                int order_type = order_type_column >= 0 && order_type_column < static_cast<int>(row.size()) ? parse_order_type(row[order_type_column]) : ORDER_TYPE_LIMIT;
+                int time_in_force = time_in_force_column >= 0 && time_in_force_column < static_cast<int>(row.size()) ? parse_time_in_force(row[time_in_force_column]) : TIME_IN_FORCE_DAY;
+                double price = (order_type == ORDER_TYPE_MARKET || order_type == ORDER_TYPE_STOP) && row[4].empty() ? 0.0 : std::stod(row[4]);
+                double stop_price = stop_price_column >= 0 && stop_price_column < static_cast<int>(row.size()) && !row[stop_price_column].empty() ? std::stod(row[stop_price_column]) : 0.0;
+                int display_quantity = display_quantity_column >= 0 && display_quantity_column < static_cast<int>(row.size()) && !row[display_quantity_column].empty() ? safe_stoi(row[display_quantity_column]) : 0;
+                
+                orders.emplace_back(generate_order_id(order_count), row[0], row[1], side, price, quantity);
+                orders.back().order_type = order_type;
+                orders.back().time_in_force = time_in_force;
+                orders.back().stop_price = stop_price;
+                orders.back().display_quantity = display_quantity;
+                orders.back().trader_id = trader_column >= 0 && trader_column < static_cast<int>(row.size()) ? traders.intern(row[trader_column]) : 0;
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error parsing line: " << line << "\n" << e.what() << std::endl;
+            }
+        }
+    }
+    return orders;
+}
+
+std::vector<Order> read_orders_from_csv(const std::string& file_path) {
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Could not open file");
+
+    // gzip and zstd files are recognised by their first bytes and decompressed as they are parsed.
+    unsigned char magic[4];
+    ssize_t count = pread(fd, magic, sizeof(magic), 0);
+    compressed::Format format = compressed::detect_format(magic, count > 0 ? static_cast<size_t>(count) : 0);
+    if (format != compressed::NONE) {
+        compressed::LineReader file(fd, format);
+        return parse_orders(file);
+    }
+    InputBuffer file(fd);
+    return parse_orders(file);
+}
+
+int write_compressed_reports(const std::string& output_file_path, compressed::Format format,
+                             const std::vector<ExecutionReport>& reports) {
+    try {
+        compressed::Writer writer(output_file_path, format);
+        writer.append(EXECUTION_REPORT_HEADER, std::strlen(EXECUTION_REPORT_HEADER));
+        for (const auto& report : reports) {
+            writer.commit(format_execution_report(report, writer.reserve(execution_report_size_bound(report))));
+        }
+        writer.finish();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int write_execution_reports_to_csv(const std::string& output_file_path, const std::vector<ExecutionReport>& reports) {
+    compressed::Format format = compressed::format_for_path(output_file_path);
+    if (format != compressed::NONE) return write_compressed_reports(output_file_path, format, reports);
+
+    std::ofstream outfile(output_file_path);
+    if (!outfile.is_open()) {
+        std::cerr << "Failed to open the output file." << std::endl;
+        return 1;
+    }
+
+    outfile << EXECUTION_REPORT_HEADER;
+
+    for (const auto& report : reports) {
+        std::ostringstream line;
+        line << report.client_order_id << ","
+             << report.order_id << ","
+             << report.instrument << ","
+             << (report.side == 1 ? "Buy" : "Sell") << ","
+             << report.price << ","
+             << report.quantity << ","
+             << report.exec_status << ","
+             << report.reason << ","
+             << report.timestamp << "\n";
+        outfile << line.str();
+    }
+
+    outfile.close();
+
+    return 0;
+}
+
+int write_trade_analytics(const std::string& output_file_path, const TradeAnalytics& analytics) {
+    std::ofstream outfile(output_file_path);
+    if (!outfile.is_open()) {
+        std::cerr << "Failed to open the analytics file." << std::endl;
+        return 1;
+    }
+
+    outfile << "Instrument,Bar,Open,High,Low,Close,VWAP,Volume,Trades\n";
+    auto write_bar = [&](const char* instrument, const std::string& bar, const TradeBar& figures) {
+        outfile << instrument << "," << bar << ","
+                << figures.open << "," << figures.high << "," << figures.low << "," << figures.close << ","
+                << figures.vwap() << "," << figures.volume << "," << figures.trades << "\n";
+    };
+    // The session row of each traded instrument, then its bars by start time.
+    for (int i = 0; i < stats::MAX_INSTRUMENTS; ++i) {
+        const InstrumentAnalytics& instrument = analytics.instruments[i];
+        if (instrument.session.trades == 0) continue;
+        write_bar(stats::INSTRUMENTS[i], "Session", instrument.session);
+        for (const TradeBar& bar : instrument.bars) {
+            write_bar(stats::INSTRUMENTS[i], format_time(bar.start_ms), bar);
+        }
+    }
+
+    outfile.close();
+
+    return 0;
+}
+
+void write_order_status(std::ostream& out, const MatchingEngine& engine, const std::vector<std::string>& client_order_ids) {
+    out << "Client Order ID,Order ID,Instrument,Side,Status,Quantity,Open Quantity,Filled Quantity,Average Price\n";
+    OrderStatus status;
+    for (const std::string& id : client_order_ids) {
+        if (!engine.order_status(id, status)) {
+            out << id << ",,,,,,,,\n";
+            continue;
+        }
+        out << id << ","
+            << status.order_id << ","
+            << status.instrument << ","
+            << (status.side == 1 ? "Buy" : "Sell") << ","
+            << status.exec_status << ","
+            << status.quantity << ","
+            << status.open_quantity << ","
+            << status.filled_quantity << ","
+            << status.average_price << "\n";
+    }
+    out.flush();
+}
+
+size_t execution_report_size_bound(const ExecutionReport& report) {
+    return report.client_order_id.size() + report.order_id.size() + report.instrument.size()
+         + report.reason.size() + report.timestamp.size() + 64;
+}
+
+size_t format_execution_report(const ExecutionReport& report, char* out) {
+    char* p = out;
+    auto put = [&](const std::string& value) {
+        std::memcpy(p, value.data(), value.size());
+        p += value.size();
+        *p++ = ',';
+    };
+    put(report.client_order_id);
+    put(report.order_id);
+    put(report.instrument);
+    std::memcpy(p, report.side == 1 ? "Buy," : "Sell,", report.side == 1 ? 4 : 5);
+    p += report.side == 1 ? 4 : 5;
+    p = std::to_chars(p, p + 32, report.price, std::chars_format::general, 6).ptr;
+    *p++ = ',';
+    p = std::to_chars(p, p + 16, report.quantity).ptr;
+    *p++ = ',';
+    p = std::to_chars(p, p + 16, report.exec_status).ptr;
+    *p++ = ',';
+    put(report.reason);
+    std::memcpy(p, report.timestamp.data(), report.timestamp.size());
+    p += report.timestamp.size();
+    *p++ = '\n';
+    return p - out;
+}
+
+// Book snapshots: a header, then for each book side a SnapshotSide, its
+// levels best price first, its orders level by level in time priority, and
+// the arena of their IDs. Records are in native byte order, so a snapshot is
+// read back on the same platform it was written on.
+constexpr char SNAPSHOT_MAGIC[8] = {'F', 'X', 'B', 'O', 'O', 'K', 0, 0};
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t side_count;
+    int64_t order_count; // Orders numbered by the saving session, where the next one continues
+};
+
+struct SnapshotSide {
+    int32_t instrument; // Index into stats::INSTRUMENTS
+    int32_t side;
+    uint32_t level_count;
+    uint32_t order_count;
+    uint64_t string_bytes;
+};
+
+struct SnapshotLevel {
+    double price;
+    uint32_t order_count;
+    int32_t total_quantity;
+};
+
+struct SnapshotOrder {
+    uint32_t order_id; // Handles into the side's arena
+    uint32_t client_order_id;
+    int32_t quantity;
+    int32_t hidden_quantity;
+    int32_t display_quantity;
+    int32_t trader_id;
+};
+
+template <typename Record>
+void writeRecords(std::ofstream& out, const Record* records, size_t count) {
+    out.write(reinterpret_cast<const char*>(records), static_cast<std::streamsize>(count * sizeof(Record)));
+}
+
+// Writes the resting orders of one book side; returns false if it has none.
+template <typename Side>
+bool writeSnapshotSide(std::ofstream& out, const Side& side) {
+    std::vector<SnapshotLevel> levels;
+    std::vector<SnapshotOrder> orders;
+    StringArena strings;
+    for (const auto& entry : side.levels) {
+        SnapshotLevel level = {entry.first, 0, 0};
+        for (uint32_t index = entry.second.head; index != NO_ORDER; index = side.nodes[index].next) {
+            const OrderNode& node = side.nodes[index];
+            if (node.quantity + node.hidden_quantity == 0) continue;
+            orders.push_back({strings.add_from(side.strings, node.order_id), strings.add_from(side.strings, node.client_order_id),
+                              node.quantity, node.hidden_quantity, node.display_quantity, node.trader_id});
+            ++level.order_count;
+            level.total_quantity += node.quantity + node.hidden_quantity;
+        }
+        if (level.order_count > 0) levels.push_back(level);
+    }
+    if (orders.empty()) return false;
+
+    SnapshotSide header = {stats::instrument_index(side.instrument), side.side, static_cast<uint32_t>(levels.size()),
+                           static_cast<uint32_t>(orders.size()), strings.size()};
+    writeRecords(out, &header, 1);
+    writeRecords(out, levels.data(), levels.size());
+    writeRecords(out, orders.data(), orders.size());
+    out.write(strings.bytes(), static_cast<std::streamsize>(strings.size()));
+    return true;
+}
+
+// Checks that a side's records agree with each other: the levels hold all of
+// its orders, each level's total is the open quantity of its orders, and
+// every ID handle points at a string that ends inside the side's arena.
+bool validSnapshotSide(const SnapshotSide& side, const SnapshotLevel* levels, const SnapshotOrder* orders, const char* strings) {
+    auto valid_string = [&](uint32_t handle) {
+        uint32_t length;
+        if (uint64_t(handle) + sizeof(length) > side.string_bytes) return false;
+        std::memcpy(&length, strings + handle, sizeof(length));
+        return uint64_t(handle) + sizeof(length) + length <= side.string_bytes;
+    };
+    const SnapshotOrder* order = orders;
+    const SnapshotOrder* end = orders + side.order_count;
+    for (uint32_t l = 0; l < side.level_count; ++l) {
+        if (levels[l].order_count > static_cast<uint64_t>(end - order)) return false;
+        int64_t total = 0;
+        for (uint32_t k = 0; k < levels[l].order_count; ++k, ++order) {
+            if (order->quantity < 0 || order->hidden_quantity < 0 || order->trader_id < 0) return false;
+            if (!valid_string(order->order_id) || !valid_string(order->client_order_id)) return false;
+            total += int64_t(order->quantity) + order->hidden_quantity;
+        }
+        if (total != levels[l].total_quantity) return false;
+    }
+    return order == end;
+}
+
+// Links a snapshot's orders into a book side in their saved order. The side's
+// arena takes the snapshot's strings in one copy.
+template <typename Side>
+void loadSnapshotSide(Side& side, const SnapshotSide& header, const SnapshotLevel* levels, const SnapshotOrder* orders,
+                      const char* strings, OrderBooks& books) {
+    const char* instrument = stats::INSTRUMENTS[header.instrument];
+    if (side.instrument.empty()) {
+        side.instrument = instrument;
+        side.side = header.side;
+    }
+    uint32_t base = side.strings.append_bytes(strings, header.string_bytes);
+    side.nodes.reserve(side.nodes.size() + header.order_count);
+    bool risk = books.risk.limits.enabled();
+
+    const SnapshotOrder* order = orders;
+    for (uint32_t l = 0; l < header.level_count; ++l) {
+        PriceLevel& level = side.levels[levels[l].price];
+        level.total_quantity += levels[l].total_quantity;
+        for (uint32_t k = 0; k < levels[l].order_count; ++k, ++order) {
+            uint32_t index = side.allocate();
+            OrderNode& node = side.nodes[index];
+            node = OrderNode();
+            node.sequence = side.next_sequence++;
+            node.order_id = base + order->order_id;
+            node.client_order_id = base + order->client_order_id;
+            node.quantity = order->quantity;
+            node.hidden_quantity = order->hidden_quantity;
+            node.display_quantity = order->display_quantity;
+            node.trader_id = order->trader_id;
+            side.link_back(level, index);
+
+            books.loaded_trader_count = std::max(books.loaded_trader_count, order->trader_id);
+            int open = order->quantity + order->hidden_quantity;
+            if (risk && order->trader_id != 0) {
+                size_t slot = books.risk.slot(order->trader_id, header.instrument);
+                (header.side == 1 ? books.risk.open_buy[slot] : books.risk.open_sell[slot]) += open;
+            }
+            if (books.order_status.enabled) {
+                Order status_order(side.strings.get(node.order_id), side.strings.get(node.client_order_id), instrument,
+                                   header.side, levels[l].price, open);
+                books.order_status.add(status_order, getExecutionReportStatus("New"));
+            }
+        }
+    }
+    side.order_count += header.order_count;
+    stats::record_book_depth(header.instrument, header.side, side.order_count);
+}
+
+int MatchingEngine::save_book(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open the book snapshot file." << std::endl;
+        return 1;
+    }
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.order_count = order_count_;
+    writeRecords(out, &header, 1);
+    for (const auto& entry : books_->buy_order_books) header.side_count += writeSnapshotSide(out, entry.second);
+    for (const auto& entry : books_->sell_order_books) header.side_count += writeSnapshotSide(out, entry.second);
+    out.seekp(0);
+    writeRecords(out, &header, 1);
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write the book snapshot." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void MatchingEngine::load_book(const std::string& path) {
+    for (const auto& entry : books_->buy_order_books) {
+        if (entry.second.order_count > 0) throw std::runtime_error("A book snapshot is loaded into empty books");
+    }
+    for (const auto& entry : books_->sell_order_books) {
+        if (entry.second.order_count > 0) throw std::runtime_error("A book snapshot is loaded into empty books");
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("Could not open book snapshot " + path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* memory = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) throw std::runtime_error("Could not map book snapshot " + path);
+    std::unique_ptr<void, std::function<void(void*)>> mapping(memory, [size](void* p) { munmap(p, size); });
+
+    const char* data = static_cast<const char*>(memory);
+    size_t offset = 0;
+    auto take = [&](size_t bytes) {
+        if (bytes > size - offset) throw std::runtime_error("Truncated book snapshot " + path);
+        const char* p = data + offset;
+        offset += bytes;
+        return p;
+    };
+    SnapshotHeader header;
+    std::memcpy(&header, take(sizeof(header)), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Not a book snapshot: " + path);
+    }
+    if (header.order_count < 0 || header.order_count > std::numeric_limits<int>::max()) {
+        throw std::runtime_error("Invalid order count in snapshot " + path);
+    }
+
+    // Every side is checked before any is loaded, so a bad snapshot leaves the books empty.
+    struct LoadedSide {
+        SnapshotSide header;
+        const SnapshotLevel* levels;
+        const SnapshotOrder* orders;
+        const char* strings;
+    };
+    std::vector<LoadedSide> sides;
+    for (uint32_t s = 0; s < header.side_count; ++s) {
+        LoadedSide loaded;
+        SnapshotSide& side = loaded.header;
+        std::memcpy(&side, take(sizeof(side)), sizeof(side));
+        if (side.instrument < 0 || side.instrument >= stats::MAX_INSTRUMENTS || (side.side != 1 && side.side != 2)) {
+            throw std::runtime_error("Invalid book side in snapshot " + path);
+        }
+        loaded.levels = reinterpret_cast<const SnapshotLevel*>(take(uint64_t(side.level_count) * sizeof(SnapshotLevel)));
+        loaded.orders = reinterpret_cast<const SnapshotOrder*>(take(uint64_t(side.order_count) * sizeof(SnapshotOrder)));
+        loaded.strings = take(side.string_bytes);
+        if (!validSnapshotSide(loaded.header, loaded.levels, loaded.orders, loaded.strings)) {
+            throw std::runtime_error("Inconsistent book side in snapshot " + path);
+        }
+        sides.push_back(loaded);
+    }
+    if (offset != size) throw std::runtime_error("Trailing bytes in book snapshot " + path);
+
+    for (const LoadedSide& loaded : sides) {
+        const std::string instrument = stats::INSTRUMENTS[loaded.header.instrument];
+        if (loaded.header.side == 1) {
+            loadSnapshotSide(books_->buy_order_books[instrument], loaded.header, loaded.levels, loaded.orders, loaded.strings, *books_);
+        } else {
+            loadSnapshotSide(books_->sell_order_books[instrument], loaded.header, loaded.levels, loaded.orders, loaded.strings, *books_);
+        }
+    }
+    order_count_ = std::max(order_count_, static_cast<int>(header.order_count));
+}
+
+MatchingEngine::MatchingEngine(const EngineConfig& config) : books_(std::make_unique<OrderBooks>()) {
+    reconfigure(config);
+}
+
+void MatchingEngine::reconfigure(const EngineConfig& config) {
+    books_->rules = config.rules;
+    books_->self_trade_policy = config.self_trade_policy;
+    books_->risk.limits = config.risk_limits;
+    books_->analytics.bar_interval_ms = config.bar_interval_ms;
+    books_->order_status.enabled = config.track_order_status;
+    books_->throttle.configure(config.throttle);
+}
+
+MatchingEngine::~MatchingEngine() = default;
+
+// Every order takes a number, including those that arrive with an ID, so the
+// count matches the "ordN" numbering of order files and gateway sessions.
+void MatchingEngine::number_order(Order& order) {
+    if (order.order_id.empty()) order.order_id = generate_order_id(order_count_);
+    else ++order_count_;
+}
+
+ReportSpan MatchingEngine::submit(Order& order) {
+    reports_.clear();
+    number_order(order);
+    if (books_->order_status.enabled) books_->order_status.add(order);
+    process_order(order, *books_, reports_);
+    track_status(reports_, 0);
+    return finish_call();
+}
+
+ReportSpan MatchingEngine::collect(Order& order) {
+    reports_.clear();
+    number_order(order);
+    if (books_->order_status.enabled) books_->order_status.add(order);
+    collect_order(order, *books_, reports_);
+    track_status(reports_, 0);
+    return finish_call();
+}
+
+ReportSpan MatchingEngine::uncross() {
+    reports_.clear();
+    uncross_auction(*books_, reports_);
+    track_status(reports_, 0);
+    return finish_call();
+}
+
+ReportSpan MatchingEngine::submit_scheduled(std::vector<Order>& orders, size_t index, const AuctionSchedule& auction) {
+    reports_.clear();
+    number_order(orders[index]);
+    if (books_->order_status.enabled) books_->order_status.add(orders[index]);
+    process_session_order(orders, index, auction, *books_, reports_);
+    track_status(reports_, 0);
+    return finish_call();
+}
+
+void MatchingEngine::run(std::vector<Order>& orders, const AuctionSchedule& auction, std::vector<ExecutionReport>& reports,
+                         size_t first, size_t last) {
+    for (size_t i = first; i < std::min(last, orders.size()); ++i) {
+        number_order(orders[i]);
+        size_t first_report = reports.size();
+        if (books_->order_status.enabled) books_->order_status.add(orders[i]);
+        process_session_order(orders, i, auction, *books_, reports);
+        track_status(reports, first_report);
+    }
+}
+
+int MatchingEngine::trader_count() const {
+    return books_->loaded_trader_count;
+}
+
+const TradeAnalytics& MatchingEngine::analytics() const {
+    return books_->analytics;
+}
+
+ReportSpan MatchingEngine::release_held(bool wait) {
+    reports_.clear();
+    Throttle& throttle = books_->throttle;
+    releaseHeldOrders(*books_, reports_);
+    while (wait && throttle.held_count > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(heldOrderWaitNs(throttle)));
+        releaseHeldOrders(*books_, reports_);
+    }
+    track_status(reports_, 0);
+    return finish_call();
+}
+
+size_t MatchingEngine::held_orders() const {
+    return books_->throttle.held_count;
+}
+
+bool MatchingEngine::order_status(const std::string& client_order_id, OrderStatus& status) const {
+    return books_->order_status.get(client_order_id, status);
+}
+
+// Applies the reports from `first` on to the status index. Orders are added
+// before they are processed, while their quantity is still the submitted one.
+void MatchingEngine::track_status(const std::vector<ExecutionReport>& reports, size_t first) {
+    OrderStatusIndex& index = books_->order_status;
+    if (!index.enabled) return;
+    for (size_t i = first; i < reports.size(); ++i) index.apply(reports[i]);
+}
+
+ReportSpan MatchingEngine::finish_call() {
+    if (callback_) {
+        for (const ExecutionReport& report : reports_) callback_(report);
+    }
+    return ReportSpan(reports_.data(), reports_.size());
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine_stats.h"
+#include "order_types.h"
+#include "trade_analytics.h"
+
+// The matching engine as a library: order books, validation, matching, stops,
+// auctions and risk checks, plus the CSV reader and report formatting shared by
+// the command-line exchange and the replay harness. In-process callers submit
+// orders to a MatchingEngine and read the resulting reports directly. The C
+// API in flower_exchange.h wraps the same engine.
+
+struct Order {
+    std::string order_id;
+    std::string client_order_id;
+    std::string instrument;
+    int side;
+    int quantity;
+    double price;
+    int order_type = ORDER_TYPE_LIMIT;
+    int time_in_force = TIME_IN_FORCE_DAY;
+    double stop_price = 0; // Trigger price of stop and stop-limit orders
+    int display_quantity = 0; // Iceberg peak, 0 displays the whole quantity
+    int trader_id = 0;        // Interned trader, 0 for none
+    int session = -1; // Gateway connection that owns the order, -1 for file input
+
+    Order(const std::string& id, const std::string& cid, const std::string& instr, int sd, double pr, int qty)
+        : order_id(id), client_order_id(cid), instrument(instr), side(sd), price(pr), quantity(qty) {}
+
+    void print() const {
+        std::cout << "Order - Client Order ID: " << client_order_id
+                  << ", Instrument: " << instrument
+                  << ", Side: " << (side == 1 ? "Buy" : "Sell")
+                  << ", Quantity: " << quantity
+                  << ", Price: " << price << std::endl;
+    }
+};
+
+struct ExecutionReport {
+    std::string order_id;
+    std::string client_order_id;
+    std::string instrument;
+    int side;
+    int exec_status;
+    int quantity;
+    double price;
+    std::string reason;
+    std::string timestamp;
+    int session = -1;
+    int trader_id = 0;
+
+    ExecutionReport(const std::string& oid, const std::string& cid, const std::string& instr, int sd,
+                    int status, int qty, double pr, const std::string& r, const std::string& ts)
+        : order_id(oid), client_order_id(cid), instrument(instr), side(sd),
+          exec_status(status), quantity(qty), price(pr), reason(r), timestamp(ts) {}
+};
+
+// Call auctions at the ends of a session. Orders in a call are rested without
+// matching and crossed in one batch when the call ends.
+struct AuctionSchedule {
+    size_t open_orders = 0;  // Orders collected in the opening call
+    size_t close_orders = 0; // Orders collected in the closing call
+};
+
+// What happens when an order would trade with a resting order of the same trader.
+enum SelfTradePolicy { STP_CANCEL_NEWEST, STP_CANCEL_OLDEST, STP_CANCEL_BOTH };
+
+// Pre-trade limits applied to every trader; 0 disables a limit.
+struct RiskLimits {
+    double max_notional = 0;   // Price times quantity of one order
+    int max_open_quantity = 0; // Unfilled quantity per instrument and side
+    int max_position = 0;      // Net position per instrument, counting open orders as filled
+
+    bool enabled() const { return max_notional > 0 || max_open_quantity > 0 || max_position > 0; }
+};
+
+// Order validation rules; the defaults are the exchange's own.
+struct OrderRules {
+    int lot_size = 10; // Quantities and display quantities are multiples of it
+    int min_quantity = 10;
+    int max_quantity = 1000;
+    double tick_size = 0;        // Limit prices are multiples of it, 0 accepts any positive price
+    unsigned order_types = 0xF; // Accepted order types, bit (1 << OrderType)
+};
+
+// Message-rate limits as token buckets, checked before validation in
+// continuous trading; a rate of 0 disables a limit. Orders over a limit are
+// rejected, or held and released round-robin across traders as the buckets
+// refill. Orders without a trader count only against the global limit.
+struct ThrottleLimits {
+    double trader_rate = 0;  // Orders per second per trader
+    double trader_burst = 0; // Bucket size, 0 for one second's worth
+    double global_rate = 0;  // Orders per second from all traders together
+    double global_burst = 0;
+    bool hold = false;
+
+    bool enabled() const { return trader_rate > 0 || global_rate > 0; }
+};
+
+struct EngineConfig {
+    OrderRules rules;
+    SelfTradePolicy self_trade_policy = STP_CANCEL_NEWEST;
+    RiskLimits risk_limits;
+    ThrottleLimits throttle;
+    int64_t bar_interval_ms = 60000; // Width of the analytics time bars, 0 for one bar per session
+    bool track_order_status = false; // Keeps the index behind MatchingEngine::order_status
+};
+
+// Where an order stands after the reports produced so far.
+struct OrderStatus {
+    std::string order_id;
+    std::string instrument;
+    int side = 0;
+    int exec_status = -1;      // Status of the order's last report, -1 before its first
+    int quantity = 0;          // As submitted
+    int open_quantity = 0;     // Resting, parked as a stop or waiting for an uncross
+    int filled_quantity = 0;
+    double average_price = 0;  // Of the fills, 0 before the first
+};
+
+// The reports of one engine call, owned by the engine and valid until its next call.
+class ReportSpan {
+public:
+    ReportSpan(const ExecutionReport* first, size_t size) : first_(first), size_(size) {}
+
+    const ExecutionReport* begin() const { return first_; }
+    const ExecutionReport* end() const { return first_ + size_; }
+    const ExecutionReport& operator[](size_t index) const { return first_[index]; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    const ExecutionReport* first_;
+    size_t size_;
+};
+
+struct OrderBooks;
+
+// One exchange's books. Orders are matched as they are submitted; each call
+// returns the reports it produced and passes them to the report callback, if
+// one is set, in the same order. An engine is used from one thread at a time.
+class MatchingEngine {
+public:
+    using ReportCallback = std::function<void(const ExecutionReport&)>;
+
+    explicit MatchingEngine(const EngineConfig& config = EngineConfig());
+    ~MatchingEngine();
+
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    void on_report(ReportCallback callback) { callback_ = std::move(callback); }
+
+    // Validates and matches an order in continuous trading. An order without
+    // an order ID is numbered by the engine.
+    ReportSpan submit(Order& order);
+
+    // Validates an order and rests it without matching, as in an auction call.
+    ReportSpan collect(Order& order);
+
+    // Ends a call: crosses every instrument's book at its uncrossing price.
+    ReportSpan uncross();
+
+    // Runs orders[index] in its session phase under `auction`: the opening
+    // call, continuous trading or the closing call. The last order of a call
+    // also uncrosses the books, and the span covers both.
+    ReportSpan submit_scheduled(std::vector<Order>& orders, size_t index, const AuctionSchedule& auction);
+
+    // Runs orders[first, last) of an order file under `auction`, appending
+    // every report to `reports` instead of passing them to the callback.
+    void run(std::vector<Order>& orders, const AuctionSchedule& auction, std::vector<ExecutionReport>& reports,
+             size_t first = 0, size_t last = SIZE_MAX);
+
+    // Matches held orders whose buckets have refilled, round-robin across
+    // traders. With `wait`, sleeps until every held order is released, as at
+    // the end of an order file.
+    ReportSpan release_held(bool wait = false);
+
+    // Orders held by the throttle.
+    size_t held_orders() const;
+
+    // Writes the orders resting in the books, which stay until they are filled,
+    // to a binary snapshot: per book side, its price levels best first and each
+    // level's orders in time priority. Returns 0 on success.
+    int save_book(const std::string& path) const;
+
+    // Rests the orders of a snapshot in empty books, in their saved priority
+    // and without matching them, and continues the saving session's order
+    // numbering. Throws on a missing or malformed snapshot.
+    void load_book(const std::string& path);
+
+    // Orders submitted so far, including those of the session a loaded
+    // snapshot was saved from. Callers that number their own orders as
+    // "ord" plus a count continue from it.
+    int order_count() const { return order_count_; }
+
+    // Highest trader ID among the orders of a loaded snapshot. The server
+    // modes number the traders of their sessions after it.
+    int trader_count() const;
+
+    // Applies new rules, limits and policies to the orders that follow. The
+    // books are kept as they are.
+    void reconfigure(const EngineConfig& config);
+
+    // Trade analytics since the engine was created.
+    const TradeAnalytics& analytics() const;
+
+    // Looks up the latest order with this client order ID. Needs
+    // track_order_status; returns false for unknown IDs.
+    bool order_status(const std::string& client_order_id, OrderStatus& status) const;
+
+private:
+    ReportSpan finish_call();
+    void number_order(Order& order);
+    void track_status(const std::vector<ExecutionReport>& reports, size_t first);
+
+    std::unique_ptr<OrderBooks> books_;
+    std::vector<ExecutionReport> reports_;
+    ReportCallback callback_;
+    int order_count_ = 0;
+};
+
+// Replaces the transaction time with a constant for the whole process, so
+// that replays of the same input produce byte-identical reports.
+void set_fixed_clock(bool fixed);
+int64_t current_time_ms();
+std::string format_time(int64_t time_ms);
+std::string current_time();
+
+int safe_stoi(const std::string& str);
+int getExecutionReportStatus(const std::string& status);
+std::string generate_order_id(int& count);
+bool validate_order(const Order& order, std::string& reason, stats::Reject* reject = nullptr, const OrderRules& rules = OrderRules());
+
+std::vector<Order> read_orders_from_csv(const std::string& file_path);
+std::vector<ExecutionReport> process_orders(std::vector<Order>& orders, const AuctionSchedule& auction = AuctionSchedule(),
+                                            const EngineConfig& config = EngineConfig());
+
+constexpr const char* EXECUTION_REPORT_HEADER = "Client Order ID,Order ID,Instrument,Side,Price,Quantity,Status,Reason,Transaction Time\n";
+
+int write_execution_reports_to_csv(const std::string& output_file_path, const std::vector<ExecutionReport>& reports);
+
+// Writes a session row per traded instrument followed by its time bars.
+int write_trade_analytics(const std::string& output_file_path, const TradeAnalytics& analytics);
+
+// Writes a row per queried client order ID, with its order's status as
+// returned by MatchingEngine::order_status. Unknown IDs get empty fields.
+void write_order_status(std::ostream& out, const MatchingEngine& engine, const std::vector<std::string>& client_order_ids);
+
+// Formats a report as one CSV line, byte-identical to write_execution_reports_to_csv
+// (prices use the default ostream format, i.e. %g). `out` needs
+// execution_report_size_bound(report) bytes.
+size_t execution_report_size_bound(const ExecutionReport& report);
+size_t format_execution_report(const ExecutionReport& report, char* out);
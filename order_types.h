@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+// Order types and time-in-force codes shared by the exchange, the gateway
+// protocol and the trader application. Zero is the default (a resting limit
+// order), so order files and gateway clients that do not set them keep the
+// original behaviour.
+
+enum OrderType {
+    ORDER_TYPE_LIMIT = 0,
+    ORDER_TYPE_MARKET = 1,
+    ORDER_TYPE_STOP = 2,      // Becomes a market order once the last trade reaches the stop price
+    ORDER_TYPE_STOP_LIMIT = 3 // Becomes a limit order once the last trade reaches the stop price
+};
+
+enum TimeInForce {
+    TIME_IN_FORCE_DAY = 0, // Rest in the book until filled
+    TIME_IN_FORCE_IOC = 1, // Immediate or cancel: fill what is possible, cancel the rest
+    TIME_IN_FORCE_FOK = 2  // Fill or kill: fill completely at once or cancel
+};
+
+// CSV column names and values. Unknown values map to -1 so the order is rejected.
+constexpr const char* ORDER_TYPE_COLUMN = "Order Type";
+constexpr const char* TIME_IN_FORCE_COLUMN = "Time In Force";
+constexpr const char* STOP_PRICE_COLUMN = "Stop Price";
+constexpr const char* DISPLAY_QUANTITY_COLUMN = "Display Quantity";
+constexpr const char* TRADER_COLUMN = "Trader";
+
+inline int parse_order_type(const std::string& value) {
+    if (value.empty() || value == "Limit") return ORDER_TYPE_LIMIT;
+    if (value == "Market") return ORDER_TYPE_MARKET;
+    if (value == "Stop") return ORDER_TYPE_STOP;
+    if (value == "Stop Limit") return ORDER_TYPE_STOP_LIMIT;
+    return -1;
+}
+
+inline int parse_time_in_force(const std::string& value) {
+    if (value.empty() || value == "Day") return TIME_IN_FORCE_DAY;
+    if (value == "IOC") return TIME_IN_FORCE_IOC;
+    if (value == "FOK") return TIME_IN_FORCE_FOK;
+    return -1;
+}
+
+// Interns trader names to small integers at parse time so that matching only
+// compares integers. 0 means no trader. IDs follow first appearance, so the
+// exchange and the trader application number the traders of a file alike.
+class TraderIds {
+public:
+    int intern(const std::string& name) {
+        if (name.empty()) return 0;
+        return ids_.emplace(name, static_cast<int>(ids_.size()) + 1).first->second;
+    }
+
+private:
+    std::unordered_map<std::string, int> ids_;
+};
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "matching_engine.h"
+
+// Replay harness: runs every order file in test/inputs through the matching
+// engine library in-process with a fixed clock. Files named order-N.csv are
+// checked against the golden execution_reports-N.csv, under the engine
+// options in order-N.options if there is one. The exchange binary's
+// batch mode must then write byte-identical reports, and so must each of its
+// other modes (output writers, TCP gateway, shared-memory ingress).
+
+namespace fs = std::filesystem;
+
+struct ReplayOptions {
+    std::string engine = "./submission";
+    std::string trader = "./trader";
+    std::string inputs = "test/inputs";
+    std::string goldens = "test/outputs";
+    int port = 9450;
+    bool server_modes = true;
+};
+
+struct EngineMode {
+    std::string name;
+    std::vector<std::string> args;
+    enum class Kind { FILE, SERVE, SHM } kind = Kind::FILE;
+};
+
+pid_t spawn_process(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        std::vector<char*> argv;
+        for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+int wait_process(pid_t pid) {
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int run_process(const std::vector<std::string>& args) {
+    return wait_process(spawn_process(args));
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+std::vector<std::vector<std::string>> read_csv(const std::string& path) {
+    std::vector<std::vector<std::string>> rows;
+    std::stringstream file(read_file(path));
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        std::stringstream ss(line);
+        std::vector<std::string> row;
+        std::string cell;
+        while (std::getline(ss, cell, ',')) {
+            row.push_back(cell);
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+int column_index(const std::vector<std::string>& header, const std::string& name) {
+    auto it = std::find(header.begin(), header.end(), name);
+    return it == header.end() ? -1 : static_cast<int>(it - header.begin());
+}
+
+std::string normalize_price(const std::string& price) {
+    try {
+        std::ostringstream ss;
+        ss << std::stod(price);
+        return ss.str();
+    } catch (const std::exception&) {
+        return price;
+    }
+}
+
+// Projects a report file onto the columns shared by the engine output and the
+// golden files, normalizing the numeric side and status codes to the golden
+// spelling. Client Order ID is left out: the golden files carry the aggressor's
+// client ID on the resting order's fill rows.
+std::vector<std::string> project_reports(const std::vector<std::vector<std::string>>& rows) {
+    static const std::vector<std::string> status_names = {"New", "Rejected", "Fill", "PFill", "Cancelled"};
+    std::vector<std::string> projected;
+    if (rows.empty()) return projected;
+
+    const std::vector<std::string>& header = rows[0];
+    int order_id = column_index(header, "Order ID");
+    int instrument = column_index(header, "Instrument");
+    int side = column_index(header, "Side");
+    int status = std::max(column_index(header, "Status"), column_index(header, "Exec Status"));
+    int quantity = column_index(header, "Quantity");
+    int price = column_index(header, "Price");
+    if (order_id < 0 || instrument < 0 || side < 0 || status < 0 || quantity < 0 || price < 0) return projected;
+
+    for (size_t i = 1; i < rows.size(); ++i) {
+        const std::vector<std::string>& row = rows[i];
+        auto cell = [&](int index) { return index < static_cast<int>(row.size()) ? row[index] : std::string(); };
+
+        std::string side_value = cell(side);
+        if (side_value == "Buy") side_value = "1";
+        if (side_value == "Sell") side_value = "2";
+        std::string status_value = cell(status);
+        if (status_value.size() == 1 && status_value[0] >= '0' && status_value[0] <= '4') {
+            status_value = status_names[status_value[0] - '0'];
+        }
+
+        projected.push_back(cell(order_id) + "," + cell(instrument) + "," + side_value + "," + status_value + ","
+                            + cell(quantity) + "," + normalize_price(cell(price)));
+    }
+    return projected;
+}
+
+// The golden files list the two fills of a trade in either order, so rows are
+// compared as multisets; row order is covered by the cross-mode comparison.
+bool compare_with_golden(const std::string& output_path, const std::string& golden_path, std::string& detail) {
+    std::vector<std::string> actual = project_reports(read_csv(output_path));
+    std::vector<std::string> expected = project_reports(read_csv(golden_path));
+    std::sort(actual.begin(), actual.end());
+    std::sort(expected.begin(), expected.end());
+    if (actual == expected) return true;
+
+    std::vector<std::string> missing, unexpected;
+    std::set_difference(expected.begin(), expected.end(), actual.begin(), actual.end(), std::back_inserter(missing));
+    std::set_difference(actual.begin(), actual.end(), expected.begin(), expected.end(), std::back_inserter(unexpected));
+    detail = missing.empty() ? "unexpected report " + unexpected.front() : "missing report " + missing.front();
+    return false;
+}
+
+// Returns the line number of the first difference, or 0 if the files are identical.
+size_t first_difference(const std::string& path1, const std::string& path2) {
+    std::stringstream file1(read_file(path1)), file2(read_file(path2));
+    std::string line1, line2;
+    for (size_t line = 1;; ++line) {
+        bool more1 = static_cast<bool>(std::getline(file1, line1));
+        bool more2 = static_cast<bool>(std::getline(file2, line2));
+        if (!more1 && !more2) return 0;
+        if (more1 != more2 || line1 != line2) return line;
+    }
+}
+
+// Reads the engine options of an order file from its sibling with the
+// extension .options, such as "--stp oldest". Every mode of the exchange
+// binary gets them as arguments; the library run understands only --stp.
+bool read_engine_options(const fs::path& input, std::vector<std::string>& args, EngineConfig& config, std::string& detail) {
+    fs::path path = input;
+    path.replace_extension(".options");
+    if (!fs::exists(path)) return true;
+
+    std::stringstream tokens(read_file(path.string()));
+    std::string arg, value;
+    while (tokens >> arg) {
+        if (arg != "--stp" || !(tokens >> value)) {
+            detail = "unsupported option " + arg + " in " + path.filename().string();
+            return false;
+        }
+        if (value == "newest") config.self_trade_policy = STP_CANCEL_NEWEST;
+        else if (value == "oldest") config.self_trade_policy = STP_CANCEL_OLDEST;
+        else if (value == "both") config.self_trade_policy = STP_CANCEL_BOTH;
+        else {
+            detail = "unknown --stp value " + value + " in " + path.filename().string();
+            return false;
+        }
+        args.insert(args.end(), {arg, value});
+    }
+    return true;
+}
+
+// Runs a server mode: starts the engine with a journal, replays the input with
+// the trader application and stops the engine once every order is acknowledged.
+int run_server_mode(const ReplayOptions& options, const EngineMode& mode, const std::string& input_path,
+                    const std::string& output_path, const std::string& endpoint) {
+    std::vector<std::string> engine_args = {options.engine};
+    engine_args.insert(engine_args.end(), mode.args.begin(), mode.args.end());
+    engine_args.insert(engine_args.end(), {endpoint, "--journal", output_path, "--clock", "fixed"});
+    pid_t engine = spawn_process(engine_args);
+
+    std::vector<std::string> trader_args = {options.trader, "--file", input_path};
+    if (mode.kind == EngineMode::Kind::SERVE) {
+        trader_args.insert(trader_args.end(), {"--port", endpoint});
+    } else {
+        trader_args.insert(trader_args.end(), {"--shm", endpoint});
+    }
+
+    // The trader fails until the engine is listening, so retry for a while.
+    int result = -1;
+    for (int attempt = 0; attempt < 50 && result != 0; ++attempt) {
+        result = run_process(trader_args);
+        if (result != 0) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    kill(engine, SIGINT);
+    int engine_result = wait_process(engine);
+    return result != 0 ? result : engine_result;
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--engine path] [--trader path] [--inputs dir] [--goldens dir]"
+              << " [--port port] [--no-server]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    ReplayOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-server") {
+            options.server_modes = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--engine") options.engine = value;
+        else if (arg == "--trader") options.trader = value;
+        else if (arg == "--inputs") options.inputs = value;
+        else if (arg == "--goldens") options.goldens = value;
+        else if (arg == "--port") options.port = std::stoi(value);
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<EngineMode> modes = {
+        {"batch", {}},
+        {"uring", {"--writer", "uring"}},
+        {"pwrite", {"--writer", "pwrite"}},
+        {"direct", {"--writer", "uring", "--direct"}},
+    };
+    if (options.server_modes) {
+        modes.push_back({"gateway", {"--serve"}, EngineMode::Kind::SERVE});
+        modes.push_back({"shm", {"--shm"}, EngineMode::Kind::SHM});
+    }
+
+    set_fixed_clock(true);
+
+    std::vector<fs::path> inputs;
+    for (const auto& entry : fs::directory_iterator(options.inputs)) {
+        if (entry.path().extension() == ".csv") inputs.push_back(entry.path());
+    }
+    std::sort(inputs.begin(), inputs.end());
+    if (inputs.empty()) {
+        std::cerr << "No order files found in " << options.inputs << std::endl;
+        return 1;
+    }
+
+    char work_template[] = "/tmp/replay.XXXXXX";
+    if (!mkdtemp(work_template)) {
+        std::cerr << "Could not create a work directory." << std::endl;
+        return 1;
+    }
+    fs::path work_dir = work_template;
+
+    size_t checks = 0, failures = 0;
+    auto report = [&](bool passed, const std::string& input, const std::string& check, const std::string& detail) {
+        ++checks;
+        if (!passed) ++failures;
+        std::cout << (passed ? "PASS " : "FAIL ") << input << " [" << check << "]";
+        if (!passed && !detail.empty()) std::cout << ": " << detail;
+        std::cout << std::endl;
+    };
+
+    for (const fs::path& input : inputs) {
+        std::string name = input.filename().string();
+        std::string baseline = (work_dir / "library.csv").string();
+        std::vector<std::string> engine_args;
+        EngineConfig config;
+        std::string options_detail;
+        if (!read_engine_options(input, engine_args, config, options_detail)) {
+            report(false, name, "options", options_detail);
+            continue;
+        }
+        try {
+            std::vector<Order> orders = read_orders_from_csv(input.string());
+            if (write_execution_reports_to_csv(baseline, process_orders(orders, AuctionSchedule(), config)) != 0) {
+                throw std::runtime_error("write failed");
+            }
+        } catch (const std::exception& e) {
+            report(false, name, "library", e.what());
+            continue;
+        }
+
+        const std::string prefix = "order-";
+        if (name.rfind(prefix, 0) == 0) {
+            std::string suffix = name.substr(prefix.size());
+            fs::path golden = fs::path(options.goldens) / ("execution_reports-" + suffix);
+            if (fs::exists(golden)) {
+                std::string detail;
+                bool passed = compare_with_golden(baseline, golden.string(), detail);
+                report(passed, name, "golden", detail);
+            }
+        }
+
+        for (EngineMode mode : modes) {
+            mode.args.insert(mode.args.begin(), engine_args.begin(), engine_args.end());
+            std::string output = (work_dir / (mode.name + ".csv")).string();
+            int result;
+            if (mode.kind == EngineMode::Kind::FILE) {
+                std::vector<std::string> args = {options.engine, "--clock", "fixed"};
+                args.insert(args.end(), mode.args.begin(), mode.args.end());
+                args.insert(args.end(), {input.string(), output});
+                result = run_process(args);
+            } else {
+                std::string endpoint = mode.kind == EngineMode::Kind::SERVE
+                                           ? std::to_string(options.port)
+                                           : "/flower_replay_" + std::to_string(getpid());
+                result = run_server_mode(options, mode, input.string(), output, endpoint);
+            }
+
+            if (result != 0) {
+                report(false, name, mode.name, "exit status " + std::to_string(result));
+                continue;
+            }
+            size_t line = first_difference(baseline, output);
+            report(line == 0, name, mode.name, "differs from library output at line " + std::to_string(line));
+        }
+    }
+
+    fs::remove_all(work_dir);
+
+    std::cout << checks - failures << "/" << checks << " checks passed." << std::endl;
+    return failures == 0 ? 0 : 1;
+}
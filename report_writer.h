@@ -0,0 +1,381 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "huge_pages.h"
+#include "thread_placement.h"
+
+// Double-buffered report output. The caller formats reports straight into the
+// active buffer; when it fills up it is handed to the kernel through io_uring
+// (or to a helper thread calling pwrite when io_uring is unavailable) while the
+// caller carries on filling the other buffer. The caller only blocks when both
+// buffers are full, i.e. when the disk cannot keep up.
+//
+// `writer_cpu` pins the pwrite helper thread, or runs io_uring with a kernel
+// submission thread (SQPOLL) pinned to that CPU so submitting costs no system
+// call. `busy_poll` spins on io_uring completions instead of sleeping.
+
+class AsyncReportWriter {
+public:
+    enum class Backend { URING, PWRITE };
+
+    static constexpr size_t BUFFER_SIZE = 4 << 20;
+    static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+    AsyncReportWriter(const std::string& path, Backend backend, bool direct_io, int writer_cpu = -1, bool busy_poll = false)
+        : direct_io_(direct_io), writer_cpu_(writer_cpu), busy_poll_(busy_poll) {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | (direct_io ? O_DIRECT : 0), 0644);
+        if (fd_ < 0 && direct_io) {
+            std::cerr << "O_DIRECT is not supported for " << path << ", using buffered output." << std::endl;
+            direct_io_ = false;
+            fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open " + path + ": " + std::strerror(errno));
+        }
+
+        for (Buffer& buffer : buffers_) {
+            buffer.data = static_cast<char*>(huge_pages::allocate(BUFFER_SIZE, DIRECT_IO_ALIGNMENT));
+        }
+
+        if (backend == Backend::URING && !setup_uring()) {
+            std::cerr << "io_uring is unavailable, falling back to a pwrite thread." << std::endl;
+            backend = Backend::PWRITE;
+        }
+        backend_ = backend;
+        if (backend_ == Backend::PWRITE) {
+            helper_ = std::thread(&AsyncReportWriter::run_helper, this);
+        }
+    }
+
+    ~AsyncReportWriter() {
+        try {
+            finish();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        for (Buffer& buffer : buffers_) {
+            huge_pages::deallocate(buffer.data, BUFFER_SIZE, DIRECT_IO_ALIGNMENT);
+        }
+    }
+
+    AsyncReportWriter(const AsyncReportWriter&) = delete;
+    AsyncReportWriter& operator=(const AsyncReportWriter&) = delete;
+
+    // Returns space for at least `size` bytes in the active buffer; `size` must
+    // not exceed BUFFER_SIZE. Follow with commit() of the bytes actually used.
+    char* reserve(size_t size) {
+        if (buffers_[active_].used + size > BUFFER_SIZE) {
+            submit_active();
+        }
+        return buffers_[active_].data + buffers_[active_].used;
+    }
+
+    void commit(size_t size) {
+        buffers_[active_].used += size;
+    }
+
+    void append(const char* data, size_t size) {
+        std::memcpy(reserve(size), data, size);
+        commit(size);
+    }
+
+    // Writes out whatever is buffered and waits for all writes to complete.
+    void finish() {
+        if (fd_ < 0) return;
+
+        uint64_t file_size = file_offset_ + buffers_[active_].used;
+        if (buffers_[active_].used > 0) {
+            if (direct_io_) {
+                // O_DIRECT writes must cover whole blocks; the padding is truncated below.
+                Buffer& buffer = buffers_[active_];
+                size_t padded = (buffer.used + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+                std::memset(buffer.data + buffer.used, 0, padded - buffer.used);
+                buffer.used = padded;
+            }
+            submit_active();
+        }
+        for (size_t i = 0; i < 2; ++i) {
+            wait_for(i);
+        }
+
+        if (backend_ == Backend::PWRITE && helper_.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            work_ready_.notify_one();
+            helper_.join();
+        }
+        if (ring_fd_ >= 0) {
+            teardown_uring();
+        }
+
+        if (direct_io_ && ftruncate(fd_, file_size) < 0) {
+            error_ = std::string("ftruncate: ") + std::strerror(errno);
+        }
+        close(fd_);
+        fd_ = -1;
+
+        if (!error_.empty()) {
+            throw std::runtime_error("Report output failed: " + error_);
+        }
+    }
+
+    Backend backend() const { return backend_; }
+
+private:
+    struct Buffer {
+        char* data = nullptr;
+        size_t used = 0;
+        uint64_t offset = 0;
+        bool in_flight = false;
+    };
+
+    void submit_active() {
+        Buffer& buffer = buffers_[active_];
+
+        // O_DIRECT writes must cover whole blocks, so a partial trailing block is
+        // carried over to the start of the next buffer.
+        size_t carry = 0;
+        if (direct_io_) {
+            carry = buffer.used % DIRECT_IO_ALIGNMENT;
+            buffer.used -= carry;
+        }
+
+        buffer.offset = file_offset_;
+        file_offset_ += buffer.used;
+        buffer.in_flight = true;
+
+        if (backend_ == Backend::URING) {
+            submit_uring(active_);
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_[active_] = true;
+            }
+            work_ready_.notify_one();
+        }
+
+        active_ ^= 1;
+        wait_for(active_);
+
+        if (carry > 0) {
+            std::memcpy(buffers_[active_].data, buffer.data + buffer.used, carry);
+            buffers_[active_].used = carry;
+        }
+    }
+
+    // Blocks until the given buffer is no longer being written and resets it.
+    void wait_for(size_t index) {
+        Buffer& buffer = buffers_[index];
+        if (buffer.in_flight) {
+            if (backend_ == Backend::URING) {
+                while (buffer.in_flight) {
+                    reap_uring(!busy_poll_);
+                }
+            } else {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_done_.wait(lock, [&] { return !pending_[index]; });
+                buffer.in_flight = false;
+            }
+        }
+        buffer.used = 0;
+    }
+
+    // Writes a whole range with pwrite, used by the helper thread and to finish short io_uring writes.
+    bool write_fully(const char* data, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t written = pwrite(fd_, data, size, offset);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                error_ = std::string("pwrite: ") + std::strerror(errno);
+                return false;
+            }
+            data += written;
+            size -= written;
+            offset += written;
+        }
+        return true;
+    }
+
+    void run_helper() {
+        pin_current_thread(writer_cpu_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            work_ready_.wait(lock, [&] { return stopping_ || pending_[0] || pending_[1]; });
+            size_t index = pending_[0] ? 0 : pending_[1] ? 1 : 2;
+            if (index == 2) return;
+
+            lock.unlock();
+            write_fully(buffers_[index].data, buffers_[index].used, buffers_[index].offset);
+            lock.lock();
+            pending_[index] = false;
+            work_done_.notify_one();
+        }
+    }
+
+    bool setup_uring() {
+        io_uring_params params{};
+        if (writer_cpu_ >= 0) {
+            params.flags = IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = writer_cpu_;
+            params.sq_thread_idle = 1000; // Milliseconds before the submission thread sleeps
+            ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, 4, &params));
+            if (ring_fd_ < 0) {
+                std::cerr << "io_uring SQPOLL is unavailable (" << std::strerror(errno) << "), submitting with system calls." << std::endl;
+                params = io_uring_params{};
+            }
+        }
+        if (ring_fd_ < 0) ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, 4, &params));
+        if (ring_fd_ < 0) return false;
+        sqpoll_ = (params.flags & IORING_SETUP_SQPOLL) != 0;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+        if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+            teardown_uring();
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<std::atomic<unsigned>*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sq_flags_ = reinterpret_cast<std::atomic<unsigned>*>(sq + params.sq_off.flags);
+
+        char* cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<std::atomic<unsigned>*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void teardown_uring() {
+        if (sq_ring_ && sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+        if (cq_ring_ && cq_ring_ != MAP_FAILED) munmap(cq_ring_, cq_ring_size_);
+        if (sqes_ && sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        sq_ring_ = cq_ring_ = nullptr;
+        sqes_ = nullptr;
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+
+    void submit_uring(size_t index) {
+        const Buffer& buffer = buffers_[index];
+        unsigned tail = sq_tail_->load(std::memory_order_relaxed);
+        unsigned slot = tail & sq_mask_;
+
+        io_uring_sqe& sqe = sqes_[slot];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd_;
+        sqe.addr = reinterpret_cast<uint64_t>(buffer.data);
+        sqe.len = static_cast<uint32_t>(buffer.used);
+        sqe.off = buffer.offset;
+        sqe.user_data = index;
+
+        sq_array_[slot] = slot;
+        sq_tail_->store(tail + 1, std::memory_order_release);
+
+        if (sqpoll_) {
+            // The submission thread picks the entry up; it only needs a wakeup once it has gone idle.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sq_flags_->load(std::memory_order_relaxed) & IORING_SQ_NEED_WAKEUP) {
+                syscall(__NR_io_uring_enter, ring_fd_, 0, 0, IORING_ENTER_SQ_WAKEUP, nullptr, 0);
+            }
+            return;
+        }
+
+        while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                error_ = std::string("io_uring_enter: ") + std::strerror(errno);
+                buffers_[index].in_flight = false;
+                return;
+            }
+        }
+    }
+
+    void reap_uring(bool wait) {
+        unsigned head = cq_head_->load(std::memory_order_relaxed);
+        if (head == cq_tail_->load(std::memory_order_acquire)) {
+            if (!wait) return;
+            if (syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                error_ = std::string("io_uring_enter: ") + std::strerror(errno);
+                buffers_[0].in_flight = buffers_[1].in_flight = false;
+            }
+            return;
+        }
+
+        while (head != cq_tail_->load(std::memory_order_acquire)) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            Buffer& buffer = buffers_[cqe.user_data];
+            if (cqe.res < 0) {
+                error_ = std::string("io_uring write: ") + std::strerror(-cqe.res);
+            } else if (static_cast<size_t>(cqe.res) < buffer.used) {
+                write_fully(buffer.data + cqe.res, buffer.used - cqe.res, buffer.offset + cqe.res);
+            }
+            buffer.in_flight = false;
+            ++head;
+        }
+        cq_head_->store(head, std::memory_order_release);
+    }
+
+    int fd_ = -1;
+    bool direct_io_;
+    int writer_cpu_;
+    bool busy_poll_;
+    Backend backend_ = Backend::PWRITE;
+    Buffer buffers_[2];
+    size_t active_ = 0;
+    uint64_t file_offset_ = 0;
+    std::string error_;
+
+    // pwrite helper thread
+    std::thread helper_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+    bool pending_[2] = {false, false};
+    bool stopping_ = false;
+
+    // io_uring rings
+    int ring_fd_ = -1;
+    bool sqpoll_ = false;
+    std::atomic<unsigned>* sq_flags_ = nullptr;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    size_t sqes_size_ = 0;
+    std::atomic<unsigned>* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    std::atomic<unsigned>* cq_head_ = nullptr;
+    std::atomic<unsigned>* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
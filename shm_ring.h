@@ -0,0 +1,217 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gateway_protocol.h"
+
+// Shared-memory order ingress for producers running on the same host as the
+// exchange. Producers claim slots in a single multi-producer order ring by
+// sequence number; the exchange busy-polls that ring and returns execution
+// reports through one single-producer/single-consumer ring per producer.
+// Orders and reports reuse the gateway message layouts. A producer that lets
+// its report ring fill up is disconnected rather than stalling matching.
+
+namespace shm {
+
+constexpr uint64_t MAGIC = 0x464c4f5745525348; // "FLOWERSH"
+constexpr uint32_t MAX_PRODUCERS = 8;
+constexpr uint64_t ORDER_RING_SIZE = 1 << 16;
+constexpr uint64_t REPORT_RING_SIZE = 1 << 13;
+constexpr const char* DEFAULT_NAME = "/flower_exchange";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory rings need lock-free atomics");
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Called after each empty poll. Spins for a while, then yields so a producer
+// and the exchange sharing a core still make progress.
+inline void idle_wait(uint32_t& idle_polls) {
+    if (++idle_polls < 1024) {
+        cpu_relax();
+    } else {
+        idle_polls = 0;
+        sched_yield();
+    }
+}
+
+struct alignas(64) OrderSlot {
+    std::atomic<uint64_t> sequence;
+    gateway::NewOrderMessage message; // header.reserved carries the producer index
+};
+
+// The sequence and an 80-byte order frame fit in two whole cache lines, so
+// neighbouring slots never share a line.
+static_assert(sizeof(OrderSlot) == 128, "OrderSlot should fill two cache lines");
+
+struct alignas(64) ProducerChannel {
+    std::atomic<uint32_t> attached;
+    std::atomic<uint32_t> attachments; // Counts producers that have used the channel
+    std::atomic<uint32_t> disconnected; // Set by the exchange when the report ring overflowed
+    alignas(64) std::atomic<uint64_t> report_head; // Advanced by the producer
+    alignas(64) std::atomic<uint64_t> report_tail; // Advanced by the exchange
+    alignas(64) gateway::ExecutionReportMessage reports[REPORT_RING_SIZE];
+};
+
+struct Segment {
+    uint64_t magic;
+    std::atomic<uint32_t> exchange_running;
+    alignas(64) std::atomic<uint64_t> order_tail; // Next sequence to be claimed by a producer
+    alignas(64) uint64_t order_head;              // Next sequence to be consumed, owned by the exchange
+    OrderSlot orders[ORDER_RING_SIZE];
+    ProducerChannel producers[MAX_PRODUCERS];
+};
+
+// Maps the segment. The exchange creates and initializes it; producers attach
+// to an existing one.
+inline Segment* map_segment(const std::string& name, bool create) {
+    int fd = shm_open(name.c_str(), create ? (O_CREAT | O_RDWR | O_TRUNC) : O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+    }
+    if (create && ftruncate(fd, sizeof(Segment)) < 0) {
+        std::string error = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("ftruncate " + name + ": " + error);
+    }
+
+    void* memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+    }
+
+    Segment* segment = static_cast<Segment*>(memory);
+    if (create) {
+        // The fresh mapping is zero filled, so only the order sequences need setting.
+        for (uint64_t i = 0; i < ORDER_RING_SIZE; ++i) {
+            new (&segment->orders[i].sequence) std::atomic<uint64_t>(i);
+        }
+        segment->exchange_running.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        segment->magic = MAGIC;
+    } else if (segment->magic != MAGIC) {
+        munmap(memory, sizeof(Segment));
+        throw std::runtime_error("Shared memory segment " + name + " is not an exchange ingress");
+    }
+    return segment;
+}
+
+inline void unmap_segment(Segment* segment) {
+    munmap(segment, sizeof(Segment));
+}
+
+// Producer side: claims a slot in the order ring. Returns false when the ring is full.
+inline bool try_push_order(Segment& segment, const gateway::NewOrderMessage& message) {
+    uint64_t position = segment.order_tail.load(std::memory_order_relaxed);
+    for (;;) {
+        OrderSlot& slot = segment.orders[position & (ORDER_RING_SIZE - 1)];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence - position);
+        if (difference == 0) {
+            if (segment.order_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.message = message;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = segment.order_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Exchange side: takes the next published order, if any.
+inline bool try_pop_order(Segment& segment, gateway::NewOrderMessage& message) {
+    uint64_t position = segment.order_head;
+    OrderSlot& slot = segment.orders[position & (ORDER_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+        return false;
+    }
+    message = slot.message;
+    slot.sequence.store(position + ORDER_RING_SIZE, std::memory_order_release);
+    segment.order_head = position + 1;
+    return true;
+}
+
+// Exchange side: publishes a report to a producer without waiting. If its
+// ring is full the producer is disconnected, and from then on its reports are
+// dropped, as are those of producers that have detached. Returns false if the
+// report was dropped.
+inline bool push_report(ProducerChannel& channel, const gateway::ExecutionReportMessage& report) {
+    if (!channel.attached.load(std::memory_order_relaxed) || channel.disconnected.load(std::memory_order_relaxed)) return false;
+    uint64_t tail = channel.report_tail.load(std::memory_order_relaxed);
+    if (tail - channel.report_head.load(std::memory_order_acquire) >= REPORT_RING_SIZE) {
+        channel.disconnected.store(1, std::memory_order_release);
+        return false;
+    }
+    channel.reports[tail & (REPORT_RING_SIZE - 1)] = report;
+    channel.report_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+// Exchange side: the session of orders from one attachment of a channel.
+// Each producer that attaches gets new session IDs, as a new gateway
+// connection does, so reports on the orders of a producer that has detached
+// never reach the next producer on its channel.
+inline int producer_session(uint32_t producer, uint32_t attachment) {
+    return static_cast<int>((attachment & 0x0FFFFFFF) * MAX_PRODUCERS + producer);
+}
+
+inline uint32_t session_producer(int session) {
+    return static_cast<uint32_t>(session) % MAX_PRODUCERS;
+}
+
+// True while the producer whose orders carry `session` is still the one attached to its channel.
+inline bool session_current(const Segment& segment, int session) {
+    uint32_t producer = session_producer(session);
+    return producer_session(producer, segment.producers[producer].attachments.load(std::memory_order_acquire)) == session;
+}
+
+// Producer side: takes the next report addressed to this producer, if any.
+inline bool try_pop_report(ProducerChannel& channel, gateway::ExecutionReportMessage& report) {
+    uint64_t head = channel.report_head.load(std::memory_order_relaxed);
+    if (head == channel.report_tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    report = channel.reports[head & (REPORT_RING_SIZE - 1)];
+    channel.report_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Producer side: reserves a report channel. Returns its index, or -1 if all are taken.
+inline int attach_producer(Segment& segment) {
+    for (uint32_t i = 0; i < MAX_PRODUCERS; ++i) {
+        uint32_t expected = 0;
+        if (segment.producers[i].attached.compare_exchange_strong(expected, 1)) {
+            // Skip reports left behind by a previous producer on this channel.
+            segment.producers[i].report_head.store(segment.producers[i].report_tail.load());
+            segment.producers[i].disconnected.store(0);
+            segment.producers[i].attachments.fetch_add(1);
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+inline void detach_producer(Segment& segment, int index) {
+    segment.producers[index].attached.store(0);
+}
+
+} // namespace shm
@@ -1,277 +1,848 @@
 #include <algorithm>
-#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
-#include <functional>
-#include <iomanip>
 #include <iostream>
 #include <map>
-#include <queue>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-struct Order {
-    std::string order_id;
-    std::string client_order_id;
-    std::string instrument;
-    int side;
-    int quantity;
-    double price;
-
-    Order(const std::string& id, const std::string& cid, const std::string& instr, int sd, double pr, int qty)
-        : order_id(id), client_order_id(cid), instrument(instr), side(sd), price(pr), quantity(qty) {}
-
-    void print() const {
-        std::cout << "Order - Client Order ID: " << client_order_id
-                  << ", Instrument: " << instrument
-                  << ", Side: " << (side == 1 ? "Buy" : "Sell")
-                  << ", Quantity: " << quantity
-                  << ", Price: " << price << std::endl;
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "compressed_io.h"
+#include "engine_stats.h"
+#include "gateway_protocol.h"
+#include "huge_pages.h"
+#include "matching_engine.h"
+#include "thread_placement.h"
+#include "report_writer.h"
+#include "shm_ring.h"
+
+// Set by --pin and --busy-poll.
+static ThreadPlacement thread_placement;
+
+template <typename ReportWriter>
+void write_execution_report(ReportWriter& writer, const ExecutionReport& report) {
+    writer.commit(format_execution_report(report, writer.reserve(execution_report_size_bound(report))));
+}
+
+// Matches orders one at a time and hands each batch of reports to the writer,
+// so output overlaps with matching instead of following it.
+template <typename ReportWriter>
+size_t process_orders_to_writer(std::vector<Order>& orders, ReportWriter& writer, const AuctionSchedule& auction,
+                                MatchingEngine& engine) {
+    size_t report_count = 0;
+    engine.on_report([&](const ExecutionReport& report) {
+        write_execution_report(writer, report);
+        ++report_count;
+    });
+
+    writer.append(EXECUTION_REPORT_HEADER, std::strlen(EXECUTION_REPORT_HEADER));
+    for (size_t i = 0; i < orders.size(); ++i) {
+        engine.submit_scheduled(orders, i, auction);
     }
-};
+    engine.release_held(true);
+    writer.finish();
+    return report_count;
+}
+
+// Long-running server modes: TCP gateway and shared-memory ingress
 
-struct ExecutionReport {
-    std::string order_id;
-    std::string client_order_id;
-    std::string instrument;
-    int side;
-    int exec_status;
-    int quantity;
-    double price;
-    std::string reason;
-    std::string timestamp;
-
-    ExecutionReport(const std::string& oid, const std::string& cid, const std::string& instr, int sd, 
-                    int status, int qty, double pr, const std::string& r, const std::string& ts)
-        : order_id(oid), client_order_id(cid), instrument(instr), side(sd), 
-          exec_status(status), quantity(qty), price(pr), reason(r), timestamp(ts) {}
+static volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
+}
+
+// Reports a session may have waiting for its socket, as many as a
+// shared-memory producer's report ring holds. A client that falls further
+// behind is disconnected so it cannot grow the exchange's memory.
+constexpr size_t MAX_PENDING_OUTPUT = shm::REPORT_RING_SIZE * sizeof(gateway::ExecutionReportMessage);
+
+struct GatewaySession {
+    int fd;
+    std::string input;  // Bytes received but not yet framed
+    std::string output; // Encoded reports not yet accepted by the socket
+    size_t output_offset = 0;
+    bool want_write = false;
+    bool overflowed = false; // Pending output passed MAX_PENDING_OUTPUT
+    std::unordered_map<std::string, int> trader_ids; // The session's trader names
 };
 
-// functions
-std::vector<Order> read_orders_from_csv(const std::string& file_path);
-bool validate_order(const Order& order, std::string& reason);
-std::string generate_order_id(int& count);
-std::vector<ExecutionReport> process_orders(std::vector<Order>& orders);
+int open_gateway_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
 
-std::string current_time() {
-    auto now = std::chrono::system_clock::now();
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        std::string error = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("Could not listen on port " + std::to_string(port) + ": " + error);
+    }
+    return fd;
+}
 
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+Order decode_new_order(const gateway::NewOrderMessage& message, int& order_count) {
+    Order order(generate_order_id(order_count), gateway::read_field(message.client_order_id),
+                gateway::read_field(message.instrument), message.side, message.price, message.quantity);
+    order.order_type = message.order_type;
+    order.time_in_force = message.time_in_force;
+    order.stop_price = message.stop_price;
+    order.display_quantity = message.display_quantity;
+    return order;
+}
 
-    auto now_c = std::chrono::system_clock::to_time_t(now);
+// Trader IDs are assigned by the exchange, never taken from the wire. Each
+// gateway session and shared-memory producer interns its own trader names, so
+// traders of different clients never share an ID. New IDs follow `trader_count`.
+int intern_trader(std::unordered_map<std::string, int>& trader_ids, const char (&name)[16], int& trader_count) {
+    std::string trader = gateway::read_field(name);
+    if (trader.empty()) return 0;
+    auto entry = trader_ids.emplace(trader, trader_count + 1);
+    if (entry.second) ++trader_count;
+    return entry.first->second;
+}
 
-    std::tm now_tm = *std::localtime(&now_c);
+gateway::ExecutionReportMessage make_report_message(const ExecutionReport& report) {
+    gateway::ExecutionReportMessage message{};
+    message.header.length = sizeof(message);
+    message.header.type = gateway::EXECUTION_REPORT;
+    gateway::copy_field(message.order_id, report.order_id);
+    gateway::copy_field(message.client_order_id, report.client_order_id);
+    gateway::copy_field(message.instrument, report.instrument);
+    message.side = report.side;
+    message.exec_status = report.exec_status;
+    message.quantity = report.quantity;
+    message.price = report.price;
+    gateway::copy_field(message.reason, report.reason);
+    gateway::copy_field(message.transaction_time, report.timestamp);
+    return message;
+}
 
-    std::stringstream ss;
-    ss << std::put_time(&now_tm, "%Y%m%d-%H%M%S");
-    ss << '.' << std::setfill('0') << std::setw(3) << ms.count();
+void encode_execution_report(const ExecutionReport& report, std::string& output) {
+    gateway::ExecutionReportMessage message = make_report_message(report);
+    output.append(reinterpret_cast<const char*>(&message), sizeof(message));
+}
 
-    return ss.str();
+void update_session_events(int epoll_fd, uint64_t session_id, GatewaySession& session, bool want_write) {
+    if (session.want_write == want_write) return;
+    epoll_event event{};
+    event.events = EPOLLIN | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.u64 = session_id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &event);
+    session.want_write = want_write;
 }
 
-int safe_stoi(const std::string& str) {
-    // Check if the string is empty or contains any non-digit characters
-    if(str.empty() || !std::all_of(str.begin(), str.end(), ::isdigit)) {
-        throw std::invalid_argument("Input string is not a valid integer");
+// Writes as much pending output as the socket accepts. Returns false if the
+// connection is broken.
+bool flush_session(int epoll_fd, uint64_t session_id, GatewaySession& session) {
+    while (session.output_offset < session.output.size()) {
+        ssize_t written = send(session.fd, session.output.data() + session.output_offset,
+                               session.output.size() - session.output_offset, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                stats::record_queue(stats::QUEUE_GATEWAY_OUTPUT, session.output.size() - session.output_offset);
+                update_session_events(epoll_fd, session_id, session, true);
+                return true;
+            }
+            return false;
+        }
+        session.output_offset += written;
     }
-    return std::stoi(str);
+    stats::record_queue(stats::QUEUE_GATEWAY_OUTPUT, 0);
+    session.output.clear();
+    session.output_offset = 0;
+    update_session_events(epoll_fd, session_id, session, false);
+    return true;
 }
 
-int getExecutionReportStatus(const std::string& status) {
-    static const std::map<std::string, int> statusMap = {
-        {"New", 0},
-        {"Rejected", 1},
-        {"Fill", 2},
-        {"PFill", 3}
-    };
+int run_gateway(uint16_t port, MatchingEngine& engine, AsyncReportWriter* journal) {
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
 
-    auto it = statusMap.find(status);
-    if (it != statusMap.end()) {
-        return it->second;
-    } else {
-        return -1;
+    int listen_fd = open_gateway_listener(port);
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        close(listen_fd);
+        throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(errno));
     }
-};
 
-struct BuyOrderCompare {
-    bool operator()(const Order& lhs, const Order& rhs) const {
-        return (lhs.price == rhs.price) ? lhs.client_order_id > rhs.client_order_id : lhs.price < rhs.price;
-    }
-};
+    const uint64_t listener_id = 0;
+    epoll_event listen_event{};
+    listen_event.events = EPOLLIN;
+    listen_event.data.u64 = listener_id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+    std::cout << "Gateway listening on 127.0.0.1:" << port << std::endl;
+
+    // Session ids are never reused, so reports for orders resting from a closed
+    // connection are dropped instead of reaching a new connection on the same fd.
+    std::unordered_map<uint64_t, GatewaySession> sessions;
+    uint64_t next_session_id = 1;
+
+    std::vector<uint64_t> dirty_sessions;
+    const int first_order = engine.order_count(); // Numbering continues after a loaded snapshot
+    int order_count = first_order;
+    int trader_count = engine.trader_count();
+    size_t report_count = 0;
+    char buffer[64 * 1024];
+    epoll_event events[64];
+
+    auto close_session = [&](uint64_t session_id) {
+        auto it = sessions.find(session_id);
+        if (it == sessions.end()) return;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        sessions.erase(it);
+    };
 
-struct SellOrderCompare {
-    bool operator()(const Order& lhs, const Order& rhs) const {
-        return (lhs.price == rhs.price) ? lhs.client_order_id > rhs.client_order_id : lhs.price > rhs.price;
-    }
-};
+    auto deliver = [&](const ReportSpan& reports) {
+        report_count += reports.size();
+        for (const ExecutionReport& report : reports) {
+            if (journal) write_execution_report(*journal, report);
+            auto owner = sessions.find(static_cast<uint64_t>(report.session));
+            if (owner == sessions.end() || owner->second.overflowed) continue;
+            GatewaySession& session = owner->second;
+            if (session.output.empty()) dirty_sessions.push_back(owner->first);
+            encode_execution_report(report, session.output);
+            if (session.output.size() - session.output_offset > MAX_PENDING_OUTPUT) {
+                std::cerr << "Session " << owner->first << " is not reading its reports, closing." << std::endl;
+                session.overflowed = true;
+                if (session.want_write) dirty_sessions.push_back(owner->first);
+            }
+        }
+    };
 
-ExecutionReport createExecutionReport(const Order& order, const std::string& status, int quantity, double price, const std::string& reason = "") {
-    return ExecutionReport(order.order_id, order.client_order_id, order.instrument, order.side, getExecutionReportStatus(status), quantity, price, reason, current_time());
-}
+    auto flush_dirty_sessions = [&]() {
+        for (uint64_t dirty_id : dirty_sessions) {
+            auto dirty = sessions.find(dirty_id);
+            if (dirty == sessions.end()) continue;
+            if (dirty->second.overflowed || (!dirty->second.want_write && !flush_session(epoll_fd, dirty_id, dirty->second))) {
+                close_session(dirty_id);
+            }
+        }
+        dirty_sessions.clear();
+    };
 
-template <typename OrderCompare>
-void processMatchingOrders(Order& incoming_order, std::priority_queue<Order, std::vector<Order>, OrderCompare>& opposite_orders, std::vector<ExecutionReport>& reports, bool isBuyOrder) {
-    while (!opposite_orders.empty() && ((isBuyOrder && opposite_orders.top().price <= incoming_order.price) || (!isBuyOrder && opposite_orders.top().price >= incoming_order.price)) && incoming_order.quantity > 0) {
-        const Order& top_order = opposite_orders.top();
+    while (!stop_requested) {
+        // Held orders are released as the throttle's buckets refill, so the wait is short while there are any.
+        int timeout_ms = thread_placement.busy_poll ? 0 : engine.held_orders() > 0 ? 1 : 500;
+        int ready = epoll_wait(epoll_fd, events, 64, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait: " << std::strerror(errno) << std::endl;
+            break;
+        }
 
-        int trade_quantity = std::min(incoming_order.quantity, top_order.quantity);
-        incoming_order.quantity -= trade_quantity;
-        Order modified_top_order = top_order;
-        modified_top_order.quantity -= trade_quantity;
+        for (int i = 0; i < ready; ++i) {
+            uint64_t session_id = events[i].data.u64;
+
+            if (session_id == listener_id) {
+                int client_fd;
+                while ((client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                    int one = 1;
+                    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    epoll_event event{};
+                    event.events = EPOLLIN;
+                    event.data.u64 = next_session_id;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
+                    sessions[next_session_id++].fd = client_fd;
+                }
+                continue;
+            }
 
-        reports.push_back(createExecutionReport(incoming_order, incoming_order.quantity == 0 ? "Fill" : "PFill", trade_quantity, top_order.price));
-        reports.push_back(createExecutionReport(modified_top_order, modified_top_order.quantity == 0 ? "Fill" : "PFill", trade_quantity, top_order.price));
+            auto it = sessions.find(session_id);
+            if (it == sessions.end()) continue;
+            GatewaySession& session = it->second;
 
-        opposite_orders.pop();
-        if (modified_top_order.quantity > 0) {
-            opposite_orders.push(modified_top_order);
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close_session(session_id);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !flush_session(epoll_fd, session_id, session)) {
+                close_session(session_id);
+                continue;
+            }
+            if (!(events[i].events & EPOLLIN)) continue;
+
+            bool closed = false;
+            for (;;) {
+                ssize_t received = recv(session.fd, buffer, sizeof(buffer), 0);
+                if (received > 0) {
+                    session.input.append(buffer, received);
+                    continue;
+                }
+                if (received < 0 && errno == EINTR) continue;
+                closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                break;
+            }
+
+            size_t offset = 0;
+            while (!session.overflowed && session.input.size() - offset >= sizeof(gateway::MessageHeader)) {
+                gateway::MessageHeader header;
+                std::memcpy(&header, session.input.data() + offset, sizeof(header));
+                if (header.type != gateway::NEW_ORDER || header.length != sizeof(gateway::NewOrderMessage)) {
+                    std::cerr << "Protocol error on session " << session_id << ", closing." << std::endl;
+                    closed = true;
+                    break;
+                }
+                if (session.input.size() - offset < header.length) break;
+
+                gateway::NewOrderMessage message;
+                std::memcpy(&message, session.input.data() + offset, sizeof(message));
+                offset += sizeof(message);
+
+                Order order = decode_new_order(message, order_count);
+                order.session = static_cast<int>(session_id);
+                order.trader_id = intern_trader(session.trader_ids, message.trader, trader_count);
+
+                deliver(engine.submit(order));
+            }
+            session.input.erase(0, offset);
+            flush_dirty_sessions();
+
+            if (closed) {
+                close_session(session_id);
+            }
         }
+
+        if (engine.held_orders() > 0) {
+            deliver(engine.release_held());
+            flush_dirty_sessions();
+        }
+    }
+
+    for (auto& entry : sessions) {
+        close(entry.second.fd);
     }
+    close(epoll_fd);
+    close(listen_fd);
+
+    std::cout << "Number of orders read: " << order_count - first_order << std::endl;
+    std::cout << "Number of execution reports generated: " << report_count << std::endl;
+    return 0;
 }
 
-std::vector<ExecutionReport> process_orders(std::vector<Order>& orders) {
-    std::vector<ExecutionReport> execution_reports;
-    std::map<std::string, std::priority_queue<Order, std::vector<Order>, BuyOrderCompare>> buy_order_books;
-    std::map<std::string, std::priority_queue<Order, std::vector<Order>, SellOrderCompare>> sell_order_books;
 
-    for (Order& incoming_order : orders) {
-        std::string validationReason;
-        if (!validate_order(incoming_order, validationReason)) {
-            execution_reports.push_back(createExecutionReport(incoming_order, "Rejected", incoming_order.quantity, incoming_order.price, validationReason));
-            continue;
+// Busy-polls the shared-memory order ring. Each order carries the index of the
+// producer that wrote it, and its reports go back on that producer's ring while
+// the producer stays attached.
+int run_shm_ingress(const std::string& name, MatchingEngine& engine, AsyncReportWriter* journal) {
+    std::signal(SIGINT, request_stop);
+    std::signal(SIGTERM, request_stop);
+
+    shm::Segment* segment = shm::map_segment(name, true);
+    std::cout << "Shared-memory ingress ready on " << name << std::endl;
+
+    const int first_order = engine.order_count(); // Numbering continues after a loaded snapshot
+    int order_count = first_order;
+    int trader_count = engine.trader_count();
+    // A producer's trader names are forgotten when another producer takes over its channel.
+    std::unordered_map<std::string, int> trader_ids[shm::MAX_PRODUCERS];
+    uint32_t attachments[shm::MAX_PRODUCERS] = {};
+    bool dropped[shm::MAX_PRODUCERS] = {}; // Reports were dropped since the producer attached
+    size_t report_count = 0;
+    gateway::NewOrderMessage message;
+    uint32_t idle_polls = 0;
+
+    auto deliver = [&](const ReportSpan& reports) {
+        report_count += reports.size();
+        for (const ExecutionReport& report : reports) {
+            if (journal) write_execution_report(*journal, report);
+            if (report.session < 0 || !shm::session_current(*segment, report.session)) continue;
+            uint32_t producer = shm::session_producer(report.session);
+            if (!shm::push_report(segment->producers[producer], make_report_message(report)) && !dropped[producer]) {
+                dropped[producer] = true;
+                std::cerr << "Producer " << producer << " is not reading its reports, disconnecting." << std::endl;
+            }
         }
+    };
 
-        if (incoming_order.side == 1) { // Buy order
-            if (sell_order_books[incoming_order.instrument].empty() || sell_order_books[incoming_order.instrument].top().price > incoming_order.price) {
-                execution_reports.push_back(createExecutionReport(incoming_order, "New", incoming_order.quantity, incoming_order.price));
-            }
-            processMatchingOrders<SellOrderCompare>(incoming_order, sell_order_books[incoming_order.instrument], execution_reports, true);
-            if (incoming_order.quantity > 0) {
-                buy_order_books[incoming_order.instrument].push(incoming_order);
+    while (!stop_requested) {
+        if (!shm::try_pop_order(*segment, message)) {
+            if (engine.held_orders() > 0) {
+                deliver(engine.release_held());
+                shm::cpu_relax();
+                continue;
             }
-        } else if (incoming_order.side == 2) { // Sell order
-            if (buy_order_books[incoming_order.instrument].empty() || buy_order_books[incoming_order.instrument].top().price < incoming_order.price) {
-                execution_reports.push_back(createExecutionReport(incoming_order, "New", incoming_order.quantity, incoming_order.price));
-            }
-            processMatchingOrders<BuyOrderCompare>(incoming_order, buy_order_books[incoming_order.instrument], execution_reports, false);
-            if (incoming_order.quantity > 0) {
-                sell_order_books[incoming_order.instrument].push(incoming_order);
+            if (thread_placement.busy_poll) shm::cpu_relax();
+            else shm::idle_wait(idle_polls);
+            continue;
+        }
+        idle_polls = 0;
+
+        // Reading the producers' tail costs a shared cache line, so occupancy is sampled.
+        if ((order_count & 63) == 0) {
+            stats::record_queue(stats::QUEUE_SHM_ORDERS, segment->order_tail.load(std::memory_order_relaxed) - segment->order_head);
+        }
+
+        int producer = message.header.reserved < shm::MAX_PRODUCERS ? message.header.reserved : -1;
+        if (producer >= 0) {
+            uint32_t attached = segment->producers[producer].attachments.load(std::memory_order_relaxed);
+            if (attached != attachments[producer]) {
+                attachments[producer] = attached;
+                trader_ids[producer].clear();
+                dropped[producer] = false;
             }
+            // Like a closed gateway session, a disconnected producer's orders are ignored; its resting orders stay.
+            if (segment->producers[producer].disconnected.load(std::memory_order_relaxed)) continue;
         }
+
+        Order order = decode_new_order(message, order_count);
+        order.session = producer >= 0 ? shm::producer_session(producer, attachments[producer]) : -1;
+        if (producer >= 0) order.trader_id = intern_trader(trader_ids[producer], message.trader, trader_count);
+
+        deliver(engine.submit(order));
     }
 
-    return execution_reports;
+    segment->exchange_running.store(0);
+    shm::unmap_segment(segment);
+    shm_unlink(name.c_str());
+
+    std::cout << "Number of orders read: " << order_count - first_order << std::endl;
+    std::cout << "Number of execution reports generated: " << report_count << std::endl;
+    return 0;
 }
 
+struct EngineOptions {
+    enum class Mode { FILE, SERVE, SHM } mode = Mode::FILE;
+    std::string input_file_path = "test/inputs/orders.csv"; // The path to your order CSV file
+    std::string output_file_path = "test/outputs/execution_rep.csv"; // Path for the execution report file
+    uint16_t port = gateway::DEFAULT_PORT;
+    std::string shm_name = shm::DEFAULT_NAME;
+    std::string writer = "stream"; // stream, uring or pwrite
+    bool direct_io = false;
+    std::string journal_path; // Report journal for the server modes
+    bool fixed_clock = false;
+    std::string stats_file;
+    int stats_interval_ms = 1000;
+    int stats_port = 0;
+    AuctionSchedule auction; // File mode only
+    EngineConfig engine; // Validation rules, self-trade prevention, risk limits and analytics bars
+    std::string analytics_path;
+    std::string status_queries_path; // Client order IDs to report the status of at the end
+    std::string status_output_path;  // Defaults to standard output
+    std::string load_book_path; // Book snapshot rested before the first order
+    std::string save_book_path; // Book snapshot written when the session ends
+    std::string sweep_path; // Scenario file, file mode only
+    int jobs = 1;           // Scenarios run at once in a sweep
+    ThreadPlacement placement;
+    huge_pages::Mode huge_page_mode = huge_pages::OFF;
+};
 
-std::string generate_order_id(int& count) {
-    return "ord" + std::to_string(++count);
+// Options that set the engine's rules and policies. They are also the
+// options of the scenarios in a sweep file.
+bool is_engine_option(const std::string& arg) {
+    static const std::set<std::string> names = {
+        "--stp", "--max-notional", "--max-open-quantity", "--max-position", "--bar-interval",
+        "--lot-size", "--min-quantity", "--max-quantity", "--tick-size", "--order-types",
+        "--trader-rate", "--trader-burst", "--global-rate", "--global-burst", "--throttle"};
+    return names.count(arg) > 0;
 }
 
-bool validate_order(const Order& order, std::string& reason) {
-    static const std::set<std::string> valid_instruments = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
-    
-    if (valid_instruments.find(order.instrument) == valid_instruments.end()) {
-        reason = "Invalid instrument: " + order.instrument;
-        return false;
-    }
-
-    if (order.side != 1 && order.side != 2) {
-        reason = "Invalid side for order " + order.client_order_id + ": " + std::to_string(order.side);
+bool parse_engine_option(const std::string& arg, const std::string& value, EngineConfig& config) {
+    if (arg == "--stp") {
+        if (value == "newest") config.self_trade_policy = STP_CANCEL_NEWEST;
+        else if (value == "oldest") config.self_trade_policy = STP_CANCEL_OLDEST;
+        else if (value == "both") config.self_trade_policy = STP_CANCEL_BOTH;
+        else return false;
+    } else if (arg == "--max-notional") {
+        config.risk_limits.max_notional = std::stod(value);
+    } else if (arg == "--max-open-quantity") {
+        config.risk_limits.max_open_quantity = safe_stoi(value);
+    } else if (arg == "--max-position") {
+        config.risk_limits.max_position = safe_stoi(value);
+    } else if (arg == "--trader-rate") {
+        config.throttle.trader_rate = std::stod(value);
+    } else if (arg == "--trader-burst") {
+        config.throttle.trader_burst = std::stod(value);
+    } else if (arg == "--global-rate") {
+        config.throttle.global_rate = std::stod(value);
+    } else if (arg == "--global-burst") {
+        config.throttle.global_burst = std::stod(value);
+    } else if (arg == "--throttle") {
+        if (value != "reject" && value != "hold") return false;
+        config.throttle.hold = value == "hold";
+    } else if (arg == "--bar-interval") {
+        config.bar_interval_ms = safe_stoi(value);
+    } else if (arg == "--lot-size") {
+        config.rules.lot_size = safe_stoi(value);
+        if (config.rules.lot_size == 0) return false;
+    } else if (arg == "--min-quantity") {
+        config.rules.min_quantity = safe_stoi(value);
+    } else if (arg == "--max-quantity") {
+        config.rules.max_quantity = safe_stoi(value);
+    } else if (arg == "--tick-size") {
+        config.rules.tick_size = std::stod(value);
+        if (config.rules.tick_size < 0) return false;
+    } else if (arg == "--order-types") {
+        static const std::map<std::string, int> types = {
+            {"limit", ORDER_TYPE_LIMIT}, {"market", ORDER_TYPE_MARKET}, {"stop", ORDER_TYPE_STOP}, {"stop-limit", ORDER_TYPE_STOP_LIMIT}};
+        config.rules.order_types = 0;
+        std::stringstream list(value);
+        std::string name;
+        while (std::getline(list, name, ',')) {
+            auto type = types.find(name);
+            if (type == types.end()) return false;
+            config.rules.order_types |= 1u << type->second;
+        }
+    } else {
         return false;
     }
+    return true;
+}
 
-    if (order.price <= 0) {
-        reason = "Invalid price for order " + order.client_order_id + ": " + std::to_string(order.price);
-        return false;
-    }
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] [input.csv [output.csv]]\n"
+              << "       " << program << " --serve [port] [options]\n"
+              << "       " << program << " --shm [name] [options]\n"
+              << "Options:\n"
+              << "  --writer stream|uring|pwrite  Report output backend (default stream)\n"
+              << "  --direct                      Open report output with O_DIRECT\n"
+              << "  --journal path                Write a report journal in the server modes\n"
+              << "  --clock system|fixed          Use a constant transaction time for reproducible output\n"
+              << "  --stats-file path             Periodically write engine statistics (Prometheus text format)\n"
+              << "  --stats-interval ms           Stats file refresh interval (default 1000)\n"
+              << "  --stats-port port             Serve engine statistics on a localhost port\n"
+              << "  --lot-size n                  Quantities must be multiples of n (default 10)\n"
+              << "  --min-quantity n              Smallest accepted quantity (default 10)\n"
+              << "  --max-quantity n              Largest accepted quantity (default 1000)\n"
+              << "  --tick-size x                 Limit prices must be multiples of x (default any)\n"
+              << "  --order-types list            Accepted order types: limit,market,stop,stop-limit\n"
+              << "  --stp newest|oldest|both      Self-trade prevention: cancel the incoming order, the resting one or both\n"
+              << "  --max-notional x              Reject a trader's orders above this price times quantity\n"
+              << "  --max-open-quantity n         Cap a trader's unfilled quantity per instrument and side\n"
+              << "  --max-position n              Cap a trader's net position per instrument, open orders included\n"
+              << "  --trader-rate n               Limit each trader to n orders per second\n"
+              << "  --trader-burst n              Orders a trader may send at once (default one second's worth)\n"
+              << "  --global-rate n               Limit all traders together to n orders per second\n"
+              << "  --global-burst n              Orders all traders may send at once (default one second's worth)\n"
+              << "  --throttle reject|hold        Reject orders over a rate limit, or hold them and release them fairly\n"
+              << "  --pin thread=cpu[,...]        Pin the matcher, writer and stats threads to CPUs\n"
+              << "  --busy-poll                   Spin instead of sleeping while waiting for orders or writes\n"
+              << "  --huge-pages off|transparent|explicit\n"
+              << "                                Back the order pool, input and report buffers with 2MB pages\n"
+              << "  --analytics path              Write OHLC, VWAP, volume and time bars per instrument at the end\n"
+              << "  --bar-interval ms             Analytics bar width (default 60000, 0 for one bar)\n"
+              << "  --order-status path           Report the status of the client order IDs in path at the end\n"
+              << "  --status-output path          Write the order status rows to path (default standard output)\n"
+              << "  --load-book path              Rest the orders of a book snapshot before the first order\n"
+              << "  --save-book path              Write the resting orders to a book snapshot at the end\n"
+              << "  --sweep path                  Run the scenarios in path over the input, parsed once;\n"
+              << "                                not with --stats-file, --stats-port or --order-status\n"
+              << "  --jobs n                      Scenarios run in parallel in a sweep (default 1)\n"
+              << "  --open-auction n              Collect the first n orders in an opening call auction\n"
+              << "  --close-auction n             Collect the last n orders in a closing call auction" << std::endl;
+}
 
-    if (order.quantity % 10 != 0 || order.quantity < 10 || order.quantity > 1000) {
-        reason = "Invalid quantity for order " + order.client_order_id + ": " + std::to_string(order.quantity);
-        return false;
+bool parse_options(int argc, char* argv[], EngineOptions& options) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0;
+        if (arg == "--serve") {
+            options.mode = EngineOptions::Mode::SERVE;
+            if (has_value) options.port = static_cast<uint16_t>(safe_stoi(argv[++i]));
+        } else if (arg == "--shm") {
+            options.mode = EngineOptions::Mode::SHM;
+            if (has_value) options.shm_name = argv[++i];
+        } else if (arg == "--writer" && has_value) {
+            options.writer = argv[++i];
+            if (options.writer != "stream" && options.writer != "uring" && options.writer != "pwrite") return false;
+        } else if (arg == "--direct") {
+            options.direct_io = true;
+        } else if (arg == "--journal" && has_value) {
+            options.journal_path = argv[++i];
+        } else if (arg == "--clock" && has_value) {
+            std::string clock = argv[++i];
+            if (clock != "system" && clock != "fixed") return false;
+            options.fixed_clock = clock == "fixed";
+        } else if (arg == "--stats-file" && has_value) {
+            options.stats_file = argv[++i];
+        } else if (arg == "--stats-interval" && has_value) {
+            options.stats_interval_ms = safe_stoi(argv[++i]);
+        } else if (arg == "--stats-port" && has_value) {
+            options.stats_port = safe_stoi(argv[++i]);
+        } else if (is_engine_option(arg) && has_value) {
+            if (!parse_engine_option(arg, argv[++i], options.engine)) return false;
+        } else if (arg == "--pin" && has_value) {
+            if (!parse_placement(argv[++i], options.placement)) return false;
+        } else if (arg == "--busy-poll") {
+            options.placement.busy_poll = true;
+        } else if (arg == "--huge-pages" && has_value) {
+            if (!huge_pages::parse_mode(argv[++i], options.huge_page_mode)) return false;
+        } else if (arg == "--analytics" && has_value) {
+            options.analytics_path = argv[++i];
+        } else if (arg == "--order-status" && has_value) {
+            options.status_queries_path = argv[++i];
+            options.engine.track_order_status = true;
+        } else if (arg == "--status-output" && has_value) {
+            options.status_output_path = argv[++i];
+        } else if (arg == "--load-book" && has_value) {
+            options.load_book_path = argv[++i];
+        } else if (arg == "--save-book" && has_value) {
+            options.save_book_path = argv[++i];
+        } else if (arg == "--sweep" && has_value) {
+            options.sweep_path = argv[++i];
+        } else if (arg == "--jobs" && has_value) {
+            options.jobs = safe_stoi(argv[++i]);
+        } else if (arg == "--open-auction" && has_value) {
+            options.auction.open_orders = safe_stoi(argv[++i]);
+        } else if (arg == "--close-auction" && has_value) {
+            options.auction.close_orders = safe_stoi(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0) {
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
     }
-
-    reason = "Order " + order.client_order_id + " is valid.";
+    if (positional.size() > 2 || (options.mode != EngineOptions::Mode::FILE && !positional.empty())) return false;
+    if (options.mode != EngineOptions::Mode::FILE && (options.auction.open_orders > 0 || options.auction.close_orders > 0)) return false;
+    if (options.mode != EngineOptions::Mode::FILE && !options.sweep_path.empty()) return false;
+    // A sweep forks, which is unsafe while the stats thread may hold locks, and
+    // the scenarios' counters would stay in the children anyway.
+    if (!options.sweep_path.empty() && (!options.stats_file.empty() || options.stats_port > 0)) return false;
+    // Order status is kept per engine, and a sweep's scenarios each end in their own child.
+    if (!options.sweep_path.empty() && !options.status_queries_path.empty()) return false;
+    if (options.jobs < 1) return false;
+    if (positional.size() > 0) options.input_file_path = positional[0];
+    if (positional.size() > 1) options.output_file_path = positional[1];
     return true;
 }
 
-std::vector<Order> read_orders_from_csv(const std::string& file_path) {
-    std::vector<Order> orders;
-    int order_count = 0;
+// One what-if run of a sweep: the base configuration up to order `fork_at`,
+// then the scenario's own options.
+struct Scenario {
+    std::string name;
+    size_t fork_at = 0;
+    EngineConfig config;
+};
 
-    std::ifstream file(file_path);
+// Reads a sweep file. Each line holds a scenario name, the index of the order
+// at which it forks from the base run and the engine options it changes, as in
+//   big-lots 0 --lot-size 100
+//   late-stp 5000 --stp oldest --max-position 2000
+// Text after # is ignored.
+bool read_scenarios(const std::string& path, const EngineConfig& base, std::vector<Scenario>& scenarios) {
+    std::ifstream file(path);
     if (!file.is_open()) {
-        throw std::runtime_error("Could not open file");
+        std::cerr << "Could not open the sweep file " << path << std::endl;
+        return false;
     }
-    
+
     std::string line;
-    bool is_header = true; 
-    while (std::getline(file, line)) {
-        if (is_header) {
-            is_header = false;
-            continue;
+    for (int number = 1; std::getline(file, line); ++number) {
+        std::stringstream tokens(line.substr(0, line.find('#')));
+        Scenario scenario;
+        scenario.config = base;
+        if (!(tokens >> scenario.name)) continue;
+
+        std::string fork_at, arg, value;
+        bool valid = static_cast<bool>(tokens >> fork_at);
+        try {
+            if (valid) scenario.fork_at = safe_stoi(fork_at);
+            while (valid && tokens >> arg) {
+                valid = tokens >> value && is_engine_option(arg) && parse_engine_option(arg, value, scenario.config);
+            }
+        } catch (const std::exception&) {
+            valid = false;
         }
-        if (line.empty()) continue;
+        if (!valid || scenario.name.find('/') != std::string::npos) {
+            std::cerr << path << ":" << number << ": invalid scenario" << std::endl;
+            return false;
+        }
+        scenarios.push_back(scenario);
+    }
+    return true;
+}
 
-        std::stringstream ss(line);
-        std::vector<std::string> row;
-        std::string value;
+// "reports.csv" becomes "reports.<name>.csv".
+std::string scenario_path(const std::string& path, const std::string& name) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + "." + name;
+    return path.substr(0, dot) + "." + name + path.substr(dot);
+}
 
-        while (std::getline(ss, value, ',')) {
-            row.push_back(value);
+// Runs every scenario of a sweep over orders parsed once. The parent replays
+// the base configuration and forks each scenario when it reaches the
+// scenario's fork point, so the child starts from a copy-on-write snapshot of
+// the books, the orders and the reports so far instead of replaying the
+// common prefix. Up to `jobs` children run at once; each writes its own
+// report file (and analytics file).
+int run_sweep(std::vector<Order>& orders, const EngineOptions& options, MatchingEngine& engine) {
+    std::vector<Scenario> scenarios;
+    if (!read_scenarios(options.sweep_path, options.engine, scenarios)) return 1;
+    std::stable_sort(scenarios.begin(), scenarios.end(),
+                     [](const Scenario& a, const Scenario& b) { return a.fork_at < b.fork_at; });
+
+    std::vector<ExecutionReport> reports;
+    std::map<pid_t, std::string> running;
+    int failures = 0;
+
+    auto reap = [&]() {
+        int status = 0;
+        pid_t pid = wait(&status);
+        if (pid < 0) return;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "Scenario " << running[pid] << " failed." << std::endl;
+            ++failures;
         }
+        running.erase(pid);
+    };
 
-        if (row.size() >= 5) {
-            try {
-               
-                int side = safe_stoi(row[2]);
-                int quantity = safe_stoi(row[3]);
-                double price = std::stod(row[4]);
-                
-                orders.emplace_back(generate_order_id(order_count), row[0], row[1], side, price, quantity);
-            } catch (const std::invalid_argument& e) {
-                std::cerr << "Error parsing line: " << line << "\n" << e.what() << std::endl;
+    size_t position = 0;
+    for (const Scenario& scenario : scenarios) {
+        size_t fork_at = std::min(scenario.fork_at, orders.size());
+        engine.run(orders, options.auction, reports, position, fork_at);
+        position = std::max(position, fork_at);
+
+        while (running.size() >= static_cast<size_t>(options.jobs)) reap();
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "fork: " << std::strerror(errno) << std::endl;
+            ++failures;
+            continue;
+        }
+        if (pid == 0) {
+            engine.reconfigure(scenario.config);
+            engine.run(orders, options.auction, reports, position);
+            ReportSpan released = engine.release_held(true);
+            reports.insert(reports.end(), released.begin(), released.end());
+            int result = write_execution_reports_to_csv(scenario_path(options.output_file_path, scenario.name), reports);
+            if (result == 0 && !options.analytics_path.empty()) {
+                result = write_trade_analytics(scenario_path(options.analytics_path, scenario.name), engine.analytics());
             }
+            if (result == 0 && !options.save_book_path.empty()) {
+                result = engine.save_book(scenario_path(options.save_book_path, scenario.name));
+            }
+            std::cout << "Scenario " << scenario.name << ": " << reports.size() << " execution reports" << std::endl;
+            _exit(result);
         }
+        running[pid] = scenario.name;
     }
-    return orders;
+    while (!running.empty()) reap();
+    return failures == 0 ? 0 : 1;
 }
 
-int write_execution_reports_to_csv(const std::string& output_file_path, const std::vector<ExecutionReport>& reports) {
-    std::ofstream outfile(output_file_path);
-    if (!outfile.is_open()) {
-        std::cerr << "Failed to open the output file." << std::endl;
-        return 1;
-    }
-
-    outfile << "Client Order ID,Order ID,Instrument,Side,Price,Quantity,Status,Reason,Transaction Time\n";
-
-    for (const auto& report : reports) {
-        std::ostringstream line;
-        line << report.client_order_id << ","
-             << report.order_id << ","
-             << report.instrument << ","
-             << (report.side == 1 ? "Buy" : "Sell") << ","
-             << report.price << ","
-             << report.quantity << ","
-             << report.exec_status << ","
-             << report.reason << ","
-             << report.timestamp << "\n";
-        outfile << line.str();
+// Reads one client order ID per line.
+bool read_status_queries(const std::string& path, std::vector<std::string>& client_order_ids) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) client_order_ids.push_back(line);
     }
+    return true;
+}
 
-    outfile.close();
-
-    return 0;
+std::unique_ptr<AsyncReportWriter> open_report_writer(const EngineOptions& options, const std::string& path) {
+    auto backend = options.writer == "pwrite" ? AsyncReportWriter::Backend::PWRITE : AsyncReportWriter::Backend::URING;
+    return std::make_unique<AsyncReportWriter>(path, backend, options.direct_io,
+                                               options.placement.writer_cpu, options.placement.busy_poll);
 }
 
+int main(int argc, char* argv[]) {
+    EngineOptions options;
+    try {
+        if (!parse_options(argc, argv, options)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::logic_error& e) { // invalid_argument, or out_of_range for numbers that do not fit
+        print_usage(argv[0]);
+        return 1;
+    }
+    set_fixed_clock(options.fixed_clock);
+    thread_placement = options.placement;
+    huge_pages::mode = options.huge_page_mode;
+    // Pinned before anything is allocated so that first touch keeps the engine's memory on this core's node.
+    pin_current_thread(thread_placement.matcher_cpu);
+    stats::Publisher stats_publisher(options.stats_file, options.stats_interval_ms, options.stats_port, thread_placement.stats_cpu);
+
+    MatchingEngine engine(options.engine);
+    if (!options.load_book_path.empty()) {
+        try {
+            engine.load_book(options.load_book_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    std::vector<std::string> status_queries;
+    if (!options.status_queries_path.empty() && !read_status_queries(options.status_queries_path, status_queries)) {
+        std::cerr << "Could not read order status queries from " << options.status_queries_path << std::endl;
+        return 1;
+    }
+    // Analytics, the book snapshot and order status queries are written when the session ends.
+    auto finish_session = [&](int result) {
+        if (!options.analytics_path.empty() && write_trade_analytics(options.analytics_path, engine.analytics()) != 0) result = 1;
+        if (!options.save_book_path.empty() && engine.save_book(options.save_book_path) != 0) result = 1;
+        if (options.status_queries_path.empty()) return result;
+        if (options.status_output_path.empty()) {
+            write_order_status(std::cout, engine, status_queries);
+            return result;
+        }
+        std::ofstream status_file(options.status_output_path);
+        if (!status_file.is_open()) {
+            std::cerr << "Failed to open the order status file." << std::endl;
+            return 1;
+        }
+        write_order_status(status_file, engine, status_queries);
+        return result;
+    };
 
-int main() {
-    std::string input_file_path = "test/inputs/orders.csv"; // The path to your order CSV file
-    std::string output_file_path = "test/outputs/execution_rep.csv"; // Path for the execution report file
+    if (options.mode != EngineOptions::Mode::FILE) {
+        std::unique_ptr<AsyncReportWriter> journal;
+        if (!options.journal_path.empty()) {
+            journal = open_report_writer(options, options.journal_path);
+            journal->append(EXECUTION_REPORT_HEADER, std::strlen(EXECUTION_REPORT_HEADER));
+        }
+        // Setup failures and a full string arena in a long session end the server with an error.
+        try {
+            int result = options.mode == EngineOptions::Mode::SERVE ? run_gateway(options.port, engine, journal.get())
+                                                                    : run_shm_ingress(options.shm_name, engine, journal.get());
+            if (journal) journal->finish();
+            return finish_session(result);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            if (journal) journal->finish();
+            return 1;
+        }
+    }
 
-    std::vector<Order> orders = read_orders_from_csv(input_file_path);
+    // A missing file or a truncated or corrupt .gz/.zst input throws.
+    std::vector<Order> orders;
+    try {
+        orders = read_orders_from_csv(options.input_file_path);
+    } catch (const std::exception& e) {
+        std::cerr << "Could not read orders from " << options.input_file_path << ": " << e.what() << std::endl;
+        return 1;
+    }
     std::cout << "Number of orders read: " << orders.size() << std::endl;
 
     if (orders.empty()) {
@@ -279,7 +850,42 @@ int main() {
         return 1;
     }
 
-    std::vector<ExecutionReport> reports = process_orders(orders);
+    // The file is numbered from ord1; after a loaded snapshot it continues the saving session's numbering.
+    int order_number = engine.order_count();
+    if (order_number > 0) {
+        for (Order& order : orders) order.order_id = generate_order_id(order_number);
+    }
+
+    if (!options.sweep_path.empty()) {
+        return run_sweep(orders, options, engine);
+    }
+
+    // .gz and .zst reports are compressed on the writer's own thread in place of the uring and pwrite backends.
+    compressed::Format output_format = compressed::format_for_path(options.output_file_path);
+    if (options.writer != "stream" && output_format != compressed::NONE) {
+        size_t report_count = 0;
+        try {
+            compressed::Writer writer(options.output_file_path, output_format);
+            report_count = process_orders_to_writer(orders, writer, options.auction, engine);
+        } catch (const std::exception& e) {
+            std::cerr << "Could not write " << options.output_file_path << ": " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Number of execution reports generated: " << report_count << std::endl;
+        return finish_session(report_count == 0 ? 1 : 0);
+    }
+
+    if (options.writer != "stream") {
+        std::unique_ptr<AsyncReportWriter> writer = open_report_writer(options, options.output_file_path);
+        size_t report_count = process_orders_to_writer(orders, *writer, options.auction, engine);
+        std::cout << "Number of execution reports generated: " << report_count << std::endl;
+        return finish_session(report_count == 0 ? 1 : 0);
+    }
+
+    std::vector<ExecutionReport> reports;
+    engine.run(orders, options.auction, reports);
+    ReportSpan released = engine.release_held(true);
+    reports.insert(reports.end(), released.begin(), released.end());
     std::cout << "Number of execution reports generated: " << reports.size() << std::endl;
 
     if (reports.empty()) {
@@ -287,8 +893,8 @@ int main() {
         return 1;
     }
 
-    int result = write_execution_reports_to_csv(output_file_path, reports);
+    int result = write_execution_reports_to_csv(options.output_file_path, reports);
 
-    return result;
+    return finish_session(result);
     
 }
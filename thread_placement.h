@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+#include <sched.h>
+
+// Placement of the exchange's threads on cores. Each thread pins itself before
+// it allocates or first touches its buffers, so the kernel's first-touch policy
+// puts the order books, report buffers and the shared-memory rings (mapped with
+// MAP_POPULATE by the matching thread) on the pinned core's NUMA node.
+
+struct ThreadPlacement {
+    int matcher_cpu = -1;   // Main thread: parsing, matching, gateway and shm polling
+    int writer_cpu = -1;    // Report writer: pwrite helper thread or io_uring SQPOLL thread
+    int stats_cpu = -1;     // Stats publisher thread
+    bool busy_poll = false; // Spin instead of sleeping in epoll, on the shm rings and on writer completions
+};
+
+// The CPUs the process was allowed before any thread pinned itself. New
+// threads inherit their creator's mask, so threads left unpinned go back to it
+// instead of sharing the matcher's core.
+inline const cpu_set_t& unpinned_cpus() {
+    static const cpu_set_t set = [] {
+        cpu_set_t cpus;
+        if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+            CPU_ZERO(&cpus);
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &cpus);
+        }
+        return cpus;
+    }();
+    return set;
+}
+
+inline void unpin_current_thread() {
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &unpinned_cpus());
+}
+
+// Pins the calling thread to `cpu`, or unpins it if `cpu` is negative.
+inline bool pin_current_thread(int cpu) {
+    unpinned_cpus(); // Saved before the first thread pins itself
+    if (cpu < 0) {
+        unpin_current_thread();
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0) {
+        std::cerr << "Could not pin thread to CPU " << cpu << ": " << std::strerror(error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Parses a placement such as "matcher=2,writer=3,stats=0". Threads left out stay unpinned.
+inline bool parse_placement(const std::string& spec, ThreadPlacement& placement) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) return false;
+        std::string thread = item.substr(0, equals);
+        int cpu;
+        try {
+            cpu = std::stoi(item.substr(equals + 1));
+        } catch (const std::exception&) {
+            return false;
+        }
+        if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+
+        if (thread == "matcher") placement.matcher_cpu = cpu;
+        else if (thread == "writer") placement.writer_cpu = cpu;
+        else if (thread == "stats") placement.stats_cpu = cpu;
+        else return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "engine_stats.h"
+
+// Per-instrument trade analytics kept incrementally from the fills as they
+// happen: session open, high, low, close, VWAP, volume and trade count, and
+// the same figures per time bar. Written once at the end of a session so that
+// nobody has to reparse the execution reports for them.
+
+struct TradeBar {
+    int64_t start_ms = 0; // Bucket start, milliseconds since the epoch
+    double open = 0;
+    double high = 0;
+    double low = 0;
+    double close = 0;
+    double notional = 0;
+    uint64_t volume = 0;
+    uint64_t trades = 0;
+
+    void add(double price, uint64_t quantity) {
+        if (trades == 0) {
+            open = high = low = price;
+        } else {
+            if (price > high) high = price;
+            if (price < low) low = price;
+        }
+        close = price;
+        notional += price * quantity;
+        volume += quantity;
+        ++trades;
+    }
+
+    double vwap() const { return volume > 0 ? notional / volume : 0; }
+};
+
+struct InstrumentAnalytics {
+    TradeBar session;
+    std::vector<TradeBar> bars; // In time order; buckets without trades are left out
+};
+
+struct TradeAnalytics {
+    int64_t bar_interval_ms = 60000;
+    InstrumentAnalytics instruments[stats::MAX_INSTRUMENTS];
+
+    void record(int instrument, double price, uint64_t quantity, int64_t time_ms) {
+        if (instrument < 0) return;
+        InstrumentAnalytics& analytics = instruments[instrument];
+        analytics.session.add(price, quantity);
+
+        int64_t start = bar_interval_ms > 0 ? time_ms - time_ms % bar_interval_ms : 0;
+        // The clock can step back; such trades join the current bar.
+        if (analytics.bars.empty() || start > analytics.bars.back().start_ms) {
+            analytics.bars.emplace_back();
+            analytics.bars.back().start_ms = start;
+        }
+        analytics.bars.back().add(price, quantity);
+    }
+};
@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gateway_protocol.h"
+#include "order_types.h"
+#include "shm_ring.h"
+#include "thread_placement.h"
+
+// Trader application: a load-generating client for the exchange gateway
+// (`submission --serve`) or its shared-memory ingress (`submission --shm`).
+// It keeps a window of orders in flight and measures the round-trip time from
+// sending each order to receiving its first execution report.
+
+struct TraderOptions {
+    std::string host = "127.0.0.1";
+    uint16_t port = gateway::DEFAULT_PORT;
+    size_t orders = 100000;
+    size_t window = 32;
+    std::string file;
+    std::string shm_name; // Use the shared-memory ingress instead of TCP when set
+    unsigned seed = 42;
+    int cpu = -1; // Pin the trader to this CPU
+};
+
+struct OrderRequest {
+    std::string client_order_id;
+    std::string instrument;
+    int side;
+    int quantity;
+    double price;
+    int order_type = ORDER_TYPE_LIMIT;
+    int time_in_force = TIME_IN_FORCE_DAY;
+    double stop_price = 0;
+    int display_quantity = 0;
+    std::string trader; // Sent by name; the exchange assigns the ID
+};
+
+std::vector<OrderRequest> generate_orders(size_t count, unsigned seed) {
+    static const std::vector<std::string> instruments = {"Rose", "Lavender", "Lotus", "Tulip", "Orchid"};
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> instrument(0, instruments.size() - 1);
+    std::uniform_int_distribution<int> side(1, 2);
+    std::uniform_int_distribution<int> lots(1, 100);
+    std::uniform_int_distribution<int> ticks(-20, 20);
+
+    std::vector<OrderRequest> orders;
+    orders.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        orders.push_back({std::to_string(i), instruments[instrument(rng)], side(rng), lots(rng) * 10, 100.0 + ticks(rng) * 0.5,
+                          ORDER_TYPE_LIMIT, TIME_IN_FORCE_DAY, 0, 0, ""});
+    }
+    return orders;
+}
+
+// Same rule as the exchange's CSV reader, so replayed files produce the same orders.
+int parse_digits(const std::string& str) {
+    if (str.empty() || !std::all_of(str.begin(), str.end(), ::isdigit)) {
+        throw std::invalid_argument("Input string is not a valid integer");
+    }
+    return std::stoi(str);
+}
+
+std::vector<OrderRequest> read_orders(const std::string& file_path) {
+    std::ifstream file(file_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file");
+    }
+
+    std::vector<OrderRequest> orders;
+    std::string line;
+    std::getline(file, line); // Header: the first five columns are positional, the rest are optional
+    int order_type_column = -1;
+    int time_in_force_column = -1;
+    int stop_price_column = -1;
+    int display_quantity_column = -1;
+    int trader_column = -1;
+    {
+        std::stringstream header(line);
+        std::string name;
+        for (int column = 0; std::getline(header, name, ','); ++column) {
+            if (name == ORDER_TYPE_COLUMN) order_type_column = column;
+            if (name == TIME_IN_FORCE_COLUMN) time_in_force_column = column;
+            if (name == STOP_PRICE_COLUMN) stop_price_column = column;
+            if (name == DISPLAY_QUANTITY_COLUMN) display_quantity_column = column;
+            if (name == TRADER_COLUMN) trader_column = column;
+        }
+    }
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        std::stringstream ss(line);
+        std::vector<std::string> row;
+        std::string value;
+        while (std::getline(ss, value, ',')) {
+            row.push_back(value);
+        }
+        if (row.size() < 5) continue;
+        try {
+            int order_type = order_type_column >= 0 && order_type_column < static_cast<int>(row.size()) ? parse_order_type(row[order_type_column]) : ORDER_TYPE_LIMIT;
+            int time_in_force = time_in_force_column >= 0 && time_in_force_column < static_cast<int>(row.size()) ? parse_time_in_force(row[time_in_force_column]) : TIME_IN_FORCE_DAY;
+            double price = (order_type == ORDER_TYPE_MARKET || order_type == ORDER_TYPE_STOP) && row[4].empty() ? 0.0 : std::stod(row[4]);
+            double stop_price = stop_price_column >= 0 && stop_price_column < static_cast<int>(row.size()) && !row[stop_price_column].empty() ? std::stod(row[stop_price_column]) : 0.0;
+            int display_quantity = display_quantity_column >= 0 && display_quantity_column < static_cast<int>(row.size()) && !row[display_quantity_column].empty() ? parse_digits(row[display_quantity_column]) : 0;
+            std::string trader = trader_column >= 0 && trader_column < static_cast<int>(row.size()) ? row[trader_column] : "";
+            orders.push_back({row[0], row[1], parse_digits(row[2]), parse_digits(row[3]), price, order_type, time_in_force, stop_price, display_quantity, trader});
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "Error parsing line: " << line << "\n" << e.what() << std::endl;
+        }
+    }
+    return orders;
+}
+
+int connect_to_gateway(const TraderOptions& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1) {
+        close(fd);
+        throw std::runtime_error("Invalid host address: " + options.host);
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::string error = std::strerror(errno);
+        close(fd);
+        throw std::runtime_error("Could not connect to gateway: " + error);
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+void send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+gateway::NewOrderMessage make_new_order(const OrderRequest& request) {
+    gateway::NewOrderMessage message{};
+    message.header.length = sizeof(message);
+    message.header.type = gateway::NEW_ORDER;
+    gateway::copy_field(message.client_order_id, request.client_order_id);
+    gateway::copy_field(message.instrument, request.instrument);
+    message.side = request.side >= 0 && request.side <= 255 ? request.side : 0; // Out of range sides are rejected as 0
+    message.quantity = request.quantity;
+    message.price = request.price;
+    message.order_type = static_cast<uint8_t>(request.order_type); // Unknown values (-1) arrive as 255 and are rejected
+    message.time_in_force = static_cast<uint8_t>(request.time_in_force);
+    message.stop_price = request.stop_price;
+    message.display_quantity = request.display_quantity;
+    gateway::copy_field(message.trader, request.trader);
+    return message;
+}
+
+// Matches execution reports back to the orders they acknowledge. The first
+// report carrying a client order ID acknowledges the oldest unacknowledged
+// order sent with that ID.
+class LatencyTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit LatencyTracker(size_t order_count) : sent_at_(order_count) {
+        latencies_us_.reserve(order_count);
+    }
+
+    void on_send(size_t index, const std::string& client_order_id, Clock::time_point now) {
+        sent_at_[index] = now;
+        outstanding_[client_order_id].push_back(index);
+    }
+
+    void on_report(const char* client_order_id, Clock::time_point now) {
+        ++report_count_;
+        auto it = outstanding_.find(client_order_id);
+        if (it == outstanding_.end() || it->second.empty()) return;
+        size_t index = it->second.front();
+        it->second.pop_front();
+        latencies_us_.push_back(std::chrono::duration<double, std::micro>(now - sent_at_[index]).count());
+    }
+
+    size_t acknowledged() const { return latencies_us_.size(); }
+    size_t report_count() const { return report_count_; }
+    const std::vector<double>& latencies_us() const { return latencies_us_; }
+
+private:
+    std::vector<Clock::time_point> sent_at_;
+    std::unordered_map<std::string, std::deque<size_t>> outstanding_;
+    std::vector<double> latencies_us_;
+    size_t report_count_ = 0;
+};
+
+void print_latency_summary(std::vector<double> latencies_us, double elapsed_s, size_t report_count) {
+    if (latencies_us.empty()) {
+        std::cout << "No orders were acknowledged." << std::endl;
+        return;
+    }
+    std::sort(latencies_us.begin(), latencies_us.end());
+    auto percentile = [&](double p) {
+        size_t index = std::min(latencies_us.size() - 1, static_cast<size_t>(p / 100.0 * latencies_us.size()));
+        return latencies_us[index];
+    };
+
+    std::cout << "Orders acknowledged: " << latencies_us.size() << "\n"
+              << "Execution reports received: " << report_count << "\n"
+              << std::fixed << std::setprecision(0)
+              << "Throughput: " << latencies_us.size() / elapsed_s << " orders/s\n"
+              << std::setprecision(2)
+              << "Round-trip latency (us): min " << latencies_us.front()
+              << ", p50 " << percentile(50)
+              << ", p90 " << percentile(90)
+              << ", p99 " << percentile(99)
+              << ", p99.9 " << percentile(99.9)
+              << ", max " << latencies_us.back() << std::endl;
+}
+
+int run_tcp_trader(const TraderOptions& options, const std::vector<OrderRequest>& orders) {
+    int fd = connect_to_gateway(options);
+
+    using Clock = LatencyTracker::Clock;
+    LatencyTracker tracker(orders.size());
+    size_t sent = 0;
+    std::string input;
+    std::vector<char> buffer(64 * 1024);
+    auto start = Clock::now();
+
+    while (tracker.acknowledged() < orders.size()) {
+        while (sent < orders.size() && sent - tracker.acknowledged() < options.window) {
+            gateway::NewOrderMessage message = make_new_order(orders[sent]);
+            tracker.on_send(sent, orders[sent].client_order_id, Clock::now());
+            send_all(fd, reinterpret_cast<const char*>(&message), sizeof(message));
+            ++sent;
+        }
+
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) {
+            std::cerr << "Gateway closed the connection." << std::endl;
+            break;
+        }
+        auto now = Clock::now();
+        input.append(buffer.data(), received);
+
+        size_t offset = 0;
+        while (input.size() - offset >= sizeof(gateway::ExecutionReportMessage)) {
+            gateway::ExecutionReportMessage report;
+            std::memcpy(&report, input.data() + offset, sizeof(report));
+            offset += sizeof(report);
+            tracker.on_report(report.client_order_id, now);
+        }
+        input.erase(0, offset);
+    }
+
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    close(fd);
+
+    print_latency_summary(tracker.latencies_us(), elapsed_s, tracker.report_count());
+    return 0;
+}
+
+int run_shm_trader(const TraderOptions& options, const std::vector<OrderRequest>& orders) {
+    shm::Segment* segment = shm::map_segment(options.shm_name, false);
+    int producer = shm::attach_producer(*segment);
+    if (producer < 0) {
+        shm::unmap_segment(segment);
+        throw std::runtime_error("All shared-memory producer channels are in use");
+    }
+    shm::ProducerChannel& channel = segment->producers[producer];
+
+    // Messages are built up front so the timed loop only copies them into the ring.
+    std::vector<gateway::NewOrderMessage> messages;
+    messages.reserve(orders.size());
+    for (const OrderRequest& request : orders) {
+        messages.push_back(make_new_order(request));
+        messages.back().header.reserved = static_cast<uint8_t>(producer);
+    }
+
+    using Clock = LatencyTracker::Clock;
+    LatencyTracker tracker(orders.size());
+    size_t sent = 0;
+    gateway::ExecutionReportMessage report;
+    uint32_t idle_polls = 0;
+    bool disconnected = false;
+    auto start = Clock::now();
+
+    while (tracker.acknowledged() < orders.size() && segment->exchange_running.load(std::memory_order_relaxed)) {
+        if (sent < orders.size() && sent - tracker.acknowledged() < options.window) {
+            auto now = Clock::now();
+            if (shm::try_push_order(*segment, messages[sent])) {
+                tracker.on_send(sent, orders[sent].client_order_id, now);
+                ++sent;
+            }
+        }
+
+        if (!shm::try_pop_report(channel, report)) {
+            // Reports published before the disconnect are read first.
+            if (channel.disconnected.load(std::memory_order_acquire)) {
+                disconnected = true;
+                break;
+            }
+            shm::idle_wait(idle_polls);
+            continue;
+        }
+        idle_polls = 0;
+        tracker.on_report(report.client_order_id, Clock::now());
+    }
+
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    shm::detach_producer(*segment, producer);
+    shm::unmap_segment(segment);
+
+    print_latency_summary(tracker.latencies_us(), elapsed_s, tracker.report_count());
+    if (disconnected) {
+        std::cerr << "Disconnected by the exchange: reports were not read fast enough." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int run_trader(const TraderOptions& options) {
+    pin_current_thread(options.cpu);
+    std::vector<OrderRequest> orders = options.file.empty() ? generate_orders(options.orders, options.seed)
+                                                            : read_orders(options.file);
+    if (orders.empty()) {
+        std::cerr << "No orders to send." << std::endl;
+        return 1;
+    }
+    return options.shm_name.empty() ? run_tcp_trader(options, orders) : run_shm_trader(options, orders);
+}
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--host addr] [--port port] [--orders count] [--window count]"
+              << " [--file orders.csv] [--seed seed] [--shm name] [--cpu cpu]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    TraderOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--host") options.host = value;
+            else if (arg == "--port") options.port = static_cast<uint16_t>(std::stoi(value));
+            else if (arg == "--orders") options.orders = std::stoul(value);
+            else if (arg == "--window") options.window = std::max(1ul, std::stoul(value));
+            else if (arg == "--file") options.file = value;
+            else if (arg == "--seed") options.seed = std::stoul(value);
+            else if (arg == "--shm") options.shm_name = value;
+            else if (arg == "--cpu") options.cpu = std::stoi(value);
+            else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        return run_trader(options);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}